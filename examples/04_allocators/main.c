@@ -0,0 +1,231 @@
+#include <pthread.h>
+
+#include "../../safetyct.h"
+#include "../../other/arena.h"
+#include "../../other/pool.h"
+
+//
+//  DEBUG ALLOCATION TRACKER
+//
+
+#define STRESS_THREAD_COUNT 8
+#define STRESS_ALLOCATION_COUNT 20000
+
+static int *stress_pointers[STRESS_THREAD_COUNT][STRESS_ALLOCATION_COUNT];
+static pthread_barrier_t stress_barrier;
+
+static size_t tracked_allocations(void) {
+    size_t count = 0;
+    for (size_t shard = 0; shard < SCTI_ALLOC_SHARD_COUNT; shard += 1) {
+        count += __atomic_load_n(&scti_alloc_shards[shard].count, __ATOMIC_RELAXED);
+    }
+    return count;
+}
+
+// Every thread allocates and grows its own pointers, then frees the pointers of its neighbour,
+// so that entries are inserted and erased by different threads at the same time.
+static void* stress_thread(void* const argument) {
+    size_t const thread = (size_t) argument;
+    size_t const neighbour = (thread + 1) % STRESS_THREAD_COUNT;
+
+    for (size_t i = 0; i < STRESS_ALLOCATION_COUNT; i += 1) {
+        int *number = MALLOC(1, int);
+        if (number == NULL) return NULL;
+        number = REALLOC(number, 1 + i % 4, int);
+        if (number == NULL) return NULL;
+        DEREF(number, 0) = (int) i;
+        stress_pointers[thread][i] = number;
+    }
+
+    pthread_barrier_wait(&stress_barrier);
+
+    for (size_t i = 0; i < STRESS_ALLOCATION_COUNT; i += 1) {
+        if (*stress_pointers[neighbour][i] != (int) i) return NULL;
+        FREE(stress_pointers[neighbour][i]);
+    }
+
+    return argument;
+}
+
+TEST("the allocation tracker survives 8 threads allocating and freeing across threads", {
+    pthread_t threads[STRESS_THREAD_COUNT];
+    size_t const before = tracked_allocations();
+
+    ASSERT_NONE(pthread_barrier_init(&stress_barrier, NULL, STRESS_THREAD_COUNT));
+    for (size_t thread = 0; thread < STRESS_THREAD_COUNT; thread += 1) {
+        ASSERT_NONE(pthread_create(&threads[thread], NULL, stress_thread, (void*) thread));
+    }
+    for (size_t thread = 0; thread < STRESS_THREAD_COUNT; thread += 1) {
+        void *result;
+        ASSERT_NONE(pthread_join(threads[thread], &result));
+        ASSERT_EQUAL((size_t) result, thread);
+    }
+    pthread_barrier_destroy(&stress_barrier);
+
+    ASSERT_EQUAL(tracked_allocations(), before);
+});
+
+//
+//  ARENA
+//
+
+TEST("arena_rewind frees the chunks allocated after the mark and reuses the memory", {
+    Arena arena;
+    size_t const before = tracked_allocations();
+    ASSERT_NONE(arena_init(&arena, 256));
+
+    int *first = ARENA_ALLOC(&arena, 4, int);
+    ASSERT_SOME(first != NULL);
+    ArenaMark const mark = arena_mark(&arena);
+
+    int *second = ARENA_ALLOC(&arena, 4, int);
+    ASSERT_SOME(second != NULL);
+    ASSERT_SOME(ARENA_ALLOC(&arena, 1024, char) != NULL);       // Does not fit, gets a chunk of its own.
+    ASSERT_EQUAL(tracked_allocations(), before + 2);
+
+    ASSERT_NONE(arena_rewind(&arena, mark));
+    ASSERT_EQUAL(tracked_allocations(), before + 1);
+    ASSERT_SOME(arena.chunk == mark.chunk);
+    ASSERT_EQUAL(arena.chunk->len, mark.len);
+    ASSERT_SOME(ARENA_ALLOC(&arena, 4, int) == second);
+
+    ASSERT_NONE(arena_release(&arena));
+    ASSERT_EQUAL(tracked_allocations(), before);
+    ASSERT_SOME(arena.chunk == NULL);
+    ASSERT_SOME(ARENA_ALLOC(&arena, 1, int) != NULL);         // The arena can be used again.
+    ASSERT_NONE(arena_release(&arena));
+});
+
+TEST("arena_rewind rejects a mark from another arena and leaves the arena intact", {
+    Arena arena;
+    Arena other;
+    ASSERT_NONE(arena_init(&arena, 64));
+    ASSERT_NONE(arena_init(&other, 64));
+    ASSERT_SOME(ARENA_ALLOC(&other, 1, int) != NULL);
+
+    int *number = ARENA_ALLOC(&arena, 1, int);
+    ASSERT_SOME(number != NULL);
+    *number = 42;
+    ASSERT_SOME(ARENA_ALLOC(&arena, 1024, char) != NULL);     // A second chunk.
+    ArenaChunk const* const chunk = arena.chunk;
+
+    ASSERT_EQUAL(arena_rewind(&arena, arena_mark(&other)), ARENA_ERROR_INVALID_MARK);
+    ASSERT_SOME(arena.chunk == chunk);
+    ASSERT_EQUAL(*number, 42);
+
+    ArenaMark stale = arena_mark(&arena);
+    stale.len += 1;
+    ASSERT_EQUAL(arena_rewind(&arena, stale), ARENA_ERROR_INVALID_MARK);
+    ASSERT_SOME(arena.chunk == chunk);
+
+    ASSERT_NONE(arena_release(&arena));
+    ASSERT_NONE(arena_release(&other));
+});
+
+TEST("arena allocations that overflow the size return NULL", {
+    Arena arena;
+    ASSERT_NONE(arena_init(&arena, 64));
+    ASSERT_SOME(ARENA_ALLOC(&arena, 1, int) != NULL);
+
+    ASSERT_SOME(ARENA_ALLOC(&arena, SIZE_MAX / 2, int) == NULL);
+    ASSERT_SOME(arena_alloc(&arena, SIZE_MAX - 4, 1) == NULL);
+    ASSERT_SOME(arena_alloc(&arena, SIZE_MAX - 4, 64) == NULL);
+    ASSERT_SOME(arena_alloc(&arena, SIZE_MAX - sizeof(ArenaChunk) + 1, 1) == NULL);
+    ASSERT_NONE(arena_release(&arena));
+});
+
+//
+//  POOL
+//
+
+typedef struct node {
+    struct node *next;
+    long value;
+} Node;
+
+static size_t pool_slab_count(Pool const* const pool) {
+    size_t count = 0;
+    for (PoolSlab const* slab = pool->slabs; slab != NULL; slab = slab->next) {
+        count += 1;
+    }
+    return count;
+}
+
+TEST("POOL_FREE'd objects are reused before new slab memory", {
+    POOL(Node) nodes;
+    Node *allocated[4096];
+    ASSERT_NONE(POOL_INIT(&nodes));
+
+    Node *first = POOL_ALLOC(&nodes);
+    ASSERT_SOME(first != NULL);
+    POOL_FREE(&nodes, first);
+    ASSERT_SOME(POOL_ALLOC(&nodes) == first);
+    POOL_FREE(&nodes, first);
+
+    for (size_t i = 0; i < ARRAY_LENGTH(allocated); i += 1) {
+        allocated[i] = POOL_ALLOC(&nodes);
+        ASSERT_SOME(allocated[i] != NULL);
+        allocated[i]->value = (long) i;
+    }
+    size_t const slabs = pool_slab_count(&nodes.base);
+    ASSERT_SOME(slabs > 1);
+
+    for (size_t i = 0; i < ARRAY_LENGTH(allocated); i += 1) {
+        ASSERT_EQUAL(allocated[i]->value, (long) i);
+        POOL_FREE(&nodes, allocated[i]);
+    }
+    for (size_t i = 0; i < ARRAY_LENGTH(allocated); i += 1) {
+        allocated[i] = POOL_ALLOC(&nodes);
+        ASSERT_SOME(allocated[i] != NULL);
+    }
+    ASSERT_EQUAL(pool_slab_count(&nodes.base), slabs);
+
+    for (size_t i = 0; i < ARRAY_LENGTH(allocated); i += 1) {
+        POOL_FREE(&nodes, allocated[i]);
+    }
+    ASSERT_NONE(POOL_DEINIT(&nodes));
+});
+
+static POOL(Node) shared_nodes;
+static pthread_barrier_t pool_barrier;
+
+// Caches a few objects, waits until the main thread has tried to deinitialize the pool, then flushes.
+static void* pool_thread(void* const argument) {
+    Node *allocated[8];
+
+    for (size_t i = 0; i < ARRAY_LENGTH(allocated); i += 1) {
+        allocated[i] = POOL_ALLOC(&shared_nodes);
+    }
+    for (size_t i = 0; i < ARRAY_LENGTH(allocated); i += 1) {
+        POOL_FREE(&shared_nodes, allocated[i]);
+    }
+
+    pthread_barrier_wait(&pool_barrier);
+    pthread_barrier_wait(&pool_barrier);
+    pool_flush_cache(&shared_nodes.base);
+
+    return argument;
+}
+
+TEST("pool_deinit waits until other threads have flushed their caches", {
+    pthread_t thread;
+    ASSERT_NONE(POOL_INIT(&shared_nodes));
+    ASSERT_NONE(pthread_barrier_init(&pool_barrier, NULL, 2));
+    ASSERT_NONE(pthread_create(&thread, NULL, pool_thread, NULL));
+
+    pthread_barrier_wait(&pool_barrier);
+    ASSERT_EQUAL(POOL_DEINIT(&shared_nodes), POOL_ERROR_THREAD_CACHES);
+    ASSERT_SOME(shared_nodes.base.slabs != NULL);
+    pthread_barrier_wait(&pool_barrier);
+
+    ASSERT_NONE(pthread_join(thread, NULL));
+    pthread_barrier_destroy(&pool_barrier);
+    ASSERT_EQUAL(shared_nodes.base.caches, 0);
+    ASSERT_NONE(POOL_DEINIT(&shared_nodes));
+    ASSERT_SOME(shared_nodes.base.slabs == NULL);
+});
+
+int main(void) {
+    puts("This example tests the allocators. To run the tests, compile the program with the -DTESTS flag.");
+    return 0;
+}
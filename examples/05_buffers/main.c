@@ -0,0 +1,428 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "../../safetyct.h"
+
+// The buffers write through `partial_writev`, which writes at most `writev_limit` bytes per
+// call, so that the tests can make `buffer_flush_fd` resume after a partial write.
+static size_t writev_limit = SIZE_MAX;
+static size_t writev_calls;
+
+static ssize_t partial_writev(int const fd, struct iovec const* const vectors, int const count) {
+    unsigned char bytes[4096];
+    size_t size = 0;
+
+    for (int i = 0; i < count && size < writev_limit && size < sizeof(bytes); i += 1) {
+        size_t left = writev_limit - size < sizeof(bytes) - size ? writev_limit - size : sizeof(bytes) - size;
+        size_t const length = vectors[i].iov_len < left ? vectors[i].iov_len : left;
+        memcpy(bytes + size, vectors[i].iov_base, length);
+        size += length;
+    }
+    writev_calls += 1;
+    return write(fd, bytes, size);
+}
+
+#define writev partial_writev
+#include "../../other/buffer.h"
+#undef writev
+#include "../../other/buffer_pool.h"
+
+// Flush the buffer through a pipe and read back what was written.
+static size_t flush_contents(Buffer* const buffer, char* const contents, size_t const capacity) {
+    int fds[2];
+    ssize_t length;
+
+    if (pipe(fds) != 0) return 0;
+    if (buffer_flush_fd(buffer, fds[1]) != BUFFER_ERROR_NONE) length = 0;
+    else length = read(fds[0], contents, capacity);
+    close(fds[0]);
+    close(fds[1]);
+
+    return length > 0 ? (size_t) length : 0;
+}
+
+static size_t segment_count(Buffer const* const buffer) {
+    size_t count = 0;
+    for (BufferSegment const* segment = buffer->head; segment != NULL; segment = segment->next) {
+        count += 1;
+    }
+    return count;
+}
+
+//
+//  DYNAMIC AND STATIC BUFFERS
+//
+
+TEST("buffer_reserve and buffer_commit append the bytes written to the reserved space", {
+    Buffer buffer;
+    void *space;
+    ASSERT_NONE(buffer_init_dynamic(&buffer, 4));
+
+    ASSERT_NONE(buffer_write_string(&buffer, "ab"));
+    ASSERT_NONE(buffer_reserve(&buffer, 100, &space));
+    ASSERT_SOME(buffer.cap > 102);
+    ASSERT_EQUAL(buffer.len, 2);
+    memset(space, 'c', 100);
+    ASSERT_NONE(buffer_commit(&buffer, 100));
+    ASSERT_EQUAL(buffer.len, 102);
+    ASSERT_SOME(memcmp(buffer.ptr, "abccc", 5) == 0);
+
+    ASSERT_EQUAL(buffer_commit(&buffer, buffer.cap), BUFFER_ERROR_CAPACITY_FULL);
+    ASSERT_EQUAL(buffer.len, 102);
+    ASSERT_NONE(buffer_deinit(&buffer));
+});
+
+TEST("a static buffer does not grow past its capacity", {
+    unsigned char bytes[4];
+    Buffer buffer;
+    ASSERT_NONE(buffer_init_static(&buffer, bytes, sizeof(bytes)));
+
+    ASSERT_NONE(buffer_write_string(&buffer, "abc"));
+    ASSERT_EQUAL(buffer_write_byte(&buffer, 'd'), BUFFER_ERROR_CAPACITY_FULL);
+    ASSERT_EQUAL(buffer.len, 3);
+    ASSERT_SOME(buffer.ptr == bytes);
+});
+
+TEST("sizes that overflow the length or the capacity fail with BUFFER_ERROR_CAPACITY_FULL", {
+    Buffer buffer;
+    void *space;
+    ASSERT_NONE(buffer_init_dynamic(&buffer, 16));
+    ASSERT_NONE(buffer_write_string(&buffer, "abc"));
+
+    ASSERT_EQUAL(buffer_reserve(&buffer, SIZE_MAX, &space), BUFFER_ERROR_CAPACITY_FULL);
+    ASSERT_EQUAL(buffer_reserve(&buffer, SIZE_MAX - 3, &space), BUFFER_ERROR_CAPACITY_FULL);
+    ASSERT_EQUAL(buffer_grow(&buffer, SIZE_MAX / 2 + 1), BUFFER_ERROR_CAPACITY_FULL);
+    ASSERT_EQUAL(buffer_commit(&buffer, SIZE_MAX), BUFFER_ERROR_CAPACITY_FULL);
+    ASSERT_EQUAL(buffer.len, 3);
+    ASSERT_SOME(memcmp(buffer.ptr, "abc", 3) == 0);
+
+    ASSERT_NONE(buffer_deinit(&buffer));
+});
+
+TEST("an inline buffer stays in its storage until it outgrows it", {
+    unsigned char storage[8];
+    Buffer buffer;
+    ASSERT_NONE(buffer_init_inline(&buffer, storage, sizeof(storage), BUFFER_FLAG_NONE));
+
+    ASSERT_NONE(buffer_write_string(&buffer, "abcdef"));
+    ASSERT_SOME(buffer.ptr == storage);
+    ASSERT_SOME(buffer.flags & BUFFER_FLAG_INLINE);
+
+    Buffer const copy = buffer;     // A copy shares the storage, it does not point into `buffer`.
+    ASSERT_SOME(copy.ptr == storage);
+
+    ASSERT_NONE(buffer_write_string(&buffer, "ghij"));
+    ASSERT_SOME(buffer.ptr != storage);
+    ASSERT_SOME(!(buffer.flags & BUFFER_FLAG_INLINE));
+    ASSERT_EQUAL(buffer.cap, 16);
+    ASSERT_EQUAL(buffer.moved, 6);
+    ASSERT_SOME(memcmp(buffer.ptr, "abcdefghij", 10) == 0);
+    ASSERT_NONE(buffer_deinit(&buffer));
+});
+
+TEST("buffer_deinit does not free the storage of an inline buffer", {
+    unsigned char storage[8];
+    Buffer buffer;
+    ASSERT_NONE(buffer_init_inline(&buffer, storage, sizeof(storage), BUFFER_FLAG_NONE));
+    ASSERT_NONE(buffer_write_string(&buffer, "abc"));
+    ASSERT_NONE(buffer_deinit(&buffer));
+    ASSERT_EQUAL(storage[0], 0);
+});
+
+//
+//  CHAINED BUFFERS
+//
+
+TEST("a chained buffer links new segments and never moves the written data", {
+    Buffer buffer;
+    char contents[64];
+    ASSERT_NONE(buffer_init_chained(&buffer, 8, BUFFER_FLAG_NONE));
+    ASSERT_SOME(buffer.head == NULL);
+
+    ASSERT_NONE(buffer_write_string(&buffer, "0123456"));
+    unsigned char const* const first = buffer.head->ptr;
+    ASSERT_NONE(buffer_write_string(&buffer, "789abcdefghijk"));
+    ASSERT_EQUAL(buffer.len, 21);
+    ASSERT_EQUAL(buffer.cap, 24);
+    ASSERT_EQUAL(segment_count(&buffer), 3);
+    ASSERT_SOME(buffer.head->ptr == first);
+    ASSERT_EQUAL(buffer.head->len, 8);
+
+    ASSERT_EQUAL(flush_contents(&buffer, contents, sizeof(contents)), 21);
+    ASSERT_SOME(memcmp(contents, "0123456789abcdefghijk", 21) == 0);
+    ASSERT_NONE(buffer_deinit(&buffer));
+});
+
+TEST("buffer_attach_bytes links the memory between the written bytes without copying it", {
+    Buffer buffer;
+    char attached[] = "XYZ";
+    char contents[64];
+    ASSERT_NONE(buffer_init_chained(&buffer, 16, BUFFER_FLAG_NONE));
+    ASSERT_EQUAL(buffer_attach_bytes(&buffer, attached, 0), BUFFER_ERROR_ZERO_SIZE);
+
+    ASSERT_NONE(buffer_write_string(&buffer, "ab"));
+    ASSERT_NONE(buffer_attach_bytes(&buffer, attached, 3));
+    ASSERT_SOME(buffer.tail->ptr == (unsigned char*) attached);
+    ASSERT_NONE(buffer_write_string(&buffer, "cd"));
+    ASSERT_EQUAL(buffer.len, 7);
+    ASSERT_EQUAL(segment_count(&buffer), 3);
+
+    attached[0] = 'x';      // Attached memory is read when the buffer is flushed.
+    ASSERT_EQUAL(flush_contents(&buffer, contents, sizeof(contents)), 7);
+    ASSERT_SOME(memcmp(contents, "abxYZcd", 7) == 0);
+    ASSERT_EQUAL(buffer.len, 0);
+    ASSERT_NONE(buffer_deinit(&buffer));
+});
+
+TEST("buffer_attach_bytes only accepts a chained buffer", {
+    Buffer buffer;
+    char attached[] = "XYZ";
+    ASSERT_NONE(buffer_init_dynamic(&buffer, 16));
+    ASSERT_EQUAL(buffer_attach_bytes(&buffer, attached, 3), BUFFER_ERROR_INVALID_TYPE);
+    ASSERT_NONE(buffer_deinit(&buffer));
+});
+
+TEST("buffer_flush_fd resumes a partial writev in the middle of a segment", {
+    Buffer buffer;
+    char written[300];
+    char contents[sizeof(written)];
+    ASSERT_NONE(buffer_init_chained(&buffer, 4, BUFFER_FLAG_NONE));
+
+    for (size_t i = 0; i < sizeof(written); i += 1) {
+        written[i] = (char) ('a' + i % 26);
+    }
+    ASSERT_NONE(buffer_copy_bytes(&buffer, written, sizeof(written)));
+    ASSERT_SOME(segment_count(&buffer) > BUFFER_IOV_MAX);
+
+    writev_limit = 7;
+    writev_calls = 0;
+    ASSERT_EQUAL(flush_contents(&buffer, contents, sizeof(contents)), sizeof(written));
+    writev_limit = SIZE_MAX;
+    ASSERT_EQUAL(writev_calls, (sizeof(written) + 6) / 7);
+    ASSERT_SOME(memcmp(contents, written, sizeof(written)) == 0);
+    ASSERT_EQUAL(buffer.len, 0);
+    ASSERT_NONE(buffer_deinit(&buffer));
+});
+
+TEST("buffer_clear keeps the own segments for reuse and drops the attached ones", {
+    Buffer buffer;
+    char attached[] = "XYZ";
+    char contents[64];
+    ASSERT_NONE(buffer_init_chained(&buffer, 8, BUFFER_FLAG_NONE));
+
+    ASSERT_NONE(buffer_write_string(&buffer, "0123456789"));
+    ASSERT_NONE(buffer_attach_bytes(&buffer, attached, 3));
+    ASSERT_NONE(buffer_write_string(&buffer, "abcdefghij"));
+    ASSERT_EQUAL(segment_count(&buffer), 5);
+    BufferSegment const* const head = buffer.head;
+
+    ASSERT_NONE(buffer_clear(&buffer));
+    ASSERT_EQUAL(buffer.len, 0);
+    ASSERT_EQUAL(buffer.cap, 32);
+    ASSERT_EQUAL(segment_count(&buffer), 4);
+    ASSERT_SOME(buffer.tail == head);
+    ASSERT_EQUAL(head->data[0], 0);
+
+    ASSERT_NONE(buffer_write_string(&buffer, "klmnopqrstuvwxyz0123456789abcdef"));
+    ASSERT_EQUAL(segment_count(&buffer), 4);
+    ASSERT_SOME(buffer.head == head);
+    ASSERT_EQUAL(flush_contents(&buffer, contents, sizeof(contents)), 32);
+    ASSERT_SOME(memcmp(contents, "klmnopqrstuvwxyz0123456789abcdef", 32) == 0);
+    ASSERT_NONE(buffer_deinit(&buffer));
+});
+
+//
+//  MAPPED BUFFERS
+//
+
+TEST("an anonymous mapped buffer grows with mremap and keeps its data", {
+    Buffer buffer;
+    unsigned char written[3 * 4096];
+    ASSERT_NONE(buffer_init_mapped(&buffer, -1, 4096, BUFFER_FLAG_SEQUENTIAL));
+
+    for (size_t i = 0; i < sizeof(written); i += 1) {
+        written[i] = (unsigned char) i;
+    }
+    ASSERT_NONE(buffer_write_bytes(&buffer, written, 100));
+    ASSERT_NONE(buffer_write_bytes(&buffer, written + 100, sizeof(written) - 100));
+    ASSERT_EQUAL(buffer.len, sizeof(written));
+    ASSERT_EQUAL(buffer.cap, 4 * 4096);
+    ASSERT_EQUAL(buffer.reallocs, 1);
+    ASSERT_EQUAL(buffer.moved, 0);
+    ASSERT_SOME(memcmp(buffer.ptr, written, sizeof(written)) == 0);
+    ASSERT_EQUAL(((unsigned char*) buffer.ptr)[sizeof(written)], 0);     // The kernel zeroes new pages.
+
+    ASSERT_NONE(buffer_deinit(&buffer));
+    ASSERT_SOME(buffer.ptr == NULL);
+});
+
+TEST("a mapped file follows the capacity while growing and is truncated to len on deinit", {
+    char path[] = "/tmp/sct_buffer_XXXXXX";
+    Buffer buffer;
+    struct stat info;
+    char contents[16];
+    int const fd = mkstemp(path);
+    ASSERT_SOME(fd != -1);
+    unlink(path);
+
+    ASSERT_NONE(buffer_init_mapped(&buffer, fd, 8, BUFFER_FLAG_NONE));
+    ASSERT_NONE(fstat(fd, &info));
+    ASSERT_EQUAL(info.st_size, 8);
+
+    ASSERT_NONE(buffer_write_string(&buffer, "0123456789"));
+    ASSERT_NONE(fstat(fd, &info));
+    ASSERT_EQUAL((size_t) info.st_size, buffer.cap);
+    ASSERT_EQUAL(buffer.cap, 16);
+
+    ASSERT_NONE(buffer_deinit(&buffer));
+    ASSERT_NONE(fstat(fd, &info));
+    ASSERT_EQUAL(info.st_size, 10);
+    ASSERT_EQUAL(pread(fd, contents, sizeof(contents), 0), 10);
+    ASSERT_SOME(memcmp(contents, "0123456789", 10) == 0);
+    close(fd);
+});
+
+TEST("a mapped file is truncated back when the mapping fails to grow", {
+    char path[] = "/tmp/sct_buffer_XXXXXX";
+    Buffer buffer;
+    struct stat info;
+    int const fd = mkstemp(path);
+    ASSERT_SOME(fd != -1);
+    unlink(path);
+    ASSERT_NONE(buffer_init_mapped(&buffer, fd, 4096, BUFFER_FLAG_NONE));
+
+    // The test runs in a process of its own, so the limit only makes this mremap fail.
+    struct rlimit limit;
+    limit.rlim_cur = 1ULL << 30;
+    limit.rlim_max = RLIM_INFINITY;
+    ASSERT_NONE(setrlimit(RLIMIT_AS, &limit));
+    ASSERT_EQUAL(buffer_grow(&buffer, 1ULL << 31), BUFFER_ERROR_MMAP_FAILED);
+    ASSERT_EQUAL(buffer.cap, 4096);
+    ASSERT_NONE(fstat(fd, &info));
+    ASSERT_EQUAL(info.st_size, 4096);
+
+    ASSERT_NONE(buffer_deinit(&buffer));
+    close(fd);
+});
+
+//
+//  BUFFER POOL
+//
+
+#define CLASS_1024 (10 - BUFFER_POOL_CLASS_MIN_SHIFT)
+
+TEST("buffer_pool_acquire reuses the memory of a released buffer of the same class", {
+    BufferPool pool;
+    Buffer buffer;
+    ASSERT_NONE(buffer_pool_init(&pool));
+
+    ASSERT_NONE(buffer_pool_acquire(&pool, &buffer, 1000, BUFFER_FLAG_NONE));
+    ASSERT_EQUAL(buffer.cap, 1024);
+    void* const memory = buffer.ptr;
+    ASSERT_NONE(buffer_write_string(&buffer, "abc"));
+    ASSERT_NONE(buffer_pool_release(&pool, &buffer));
+
+    ASSERT_NONE(buffer_pool_acquire(&pool, &buffer, 600, BUFFER_FLAG_NONE));
+    ASSERT_SOME(buffer.ptr == memory);
+    ASSERT_EQUAL(((unsigned char*) buffer.ptr)[0], 0);
+    ASSERT_NONE(buffer_pool_release(&pool, &buffer));
+    ASSERT_NONE(buffer_pool_deinit(&pool));
+});
+
+TEST("a released buffer is empty and allocates new memory when it is written to", {
+    BufferPool pool;
+    Buffer buffer;
+    ASSERT_NONE(buffer_pool_init(&pool));
+
+    ASSERT_NONE(buffer_pool_acquire(&pool, &buffer, 200, BUFFER_FLAG_NONE));
+    ASSERT_NONE(buffer_write_string(&buffer, "abc"));
+    ASSERT_NONE(buffer_pool_release(&pool, &buffer));
+    ASSERT_SOME(buffer.ptr == NULL);
+    ASSERT_EQUAL(buffer.cap, 0);
+    ASSERT_EQUAL(buffer.len, 0);
+
+    ASSERT_NONE(buffer_write_string(&buffer, "defgh"));
+    ASSERT_EQUAL(buffer.len, 5);
+    ASSERT_SOME(buffer.cap > 5);
+    ASSERT_SOME(memcmp(buffer.ptr, "defgh", 5) == 0);
+    ASSERT_NONE(buffer_deinit(&buffer));
+    ASSERT_NONE(buffer_pool_deinit(&pool));
+});
+
+TEST("buffer_pool_trim keeps the blocks used since the last trim and frees the idle ones", {
+    BufferPool pool;
+    Buffer buffers[4];
+    ASSERT_NONE(buffer_pool_init(&pool));
+
+    for (size_t i = 0; i < ARRAY_LENGTH(buffers); i += 1) {
+        ASSERT_NONE(buffer_pool_acquire(&pool, &buffers[i], 1000, BUFFER_FLAG_NO_ZERO));
+    }
+    for (size_t i = 0; i < ARRAY_LENGTH(buffers); i += 1) {
+        ASSERT_NONE(buffer_pool_release(&pool, &buffers[i]));
+    }
+    buffer_pool_flush_cache(&pool);
+    ASSERT_EQUAL(pool.classes[CLASS_1024].cached, 4);
+
+    // The blocks were all in use before the first trim.
+    ASSERT_NONE(buffer_pool_trim(&pool));
+    ASSERT_EQUAL(pool.classes[CLASS_1024].cached, 4);
+    ASSERT_EQUAL(pool.classes[CLASS_1024].idle, 4);
+
+    // Taking one block moves the rest to the thread cache, so the free list ran empty.
+    ASSERT_NONE(buffer_pool_acquire(&pool, &buffers[0], 1000, BUFFER_FLAG_NO_ZERO));
+    ASSERT_EQUAL(pool.classes[CLASS_1024].cached, 0);
+    ASSERT_EQUAL(pool.classes[CLASS_1024].idle, 0);
+    ASSERT_NONE(buffer_pool_release(&pool, &buffers[0]));
+    buffer_pool_flush_cache(&pool);
+    ASSERT_NONE(buffer_pool_trim(&pool));
+    ASSERT_EQUAL(pool.classes[CLASS_1024].cached, 4);
+
+    // Nothing was taken since, so every block is idle.
+    ASSERT_NONE(buffer_pool_trim(&pool));
+    ASSERT_EQUAL(pool.classes[CLASS_1024].cached, 0);
+    ASSERT_SOME(pool.classes[CLASS_1024].free == NULL);
+    ASSERT_NONE(buffer_pool_deinit(&pool));
+});
+
+static BufferPool shared_pool;
+static pthread_barrier_t pool_barrier;
+
+// Caches a block, waits until the main thread has tried to deinitialize the pool, then flushes.
+static void* pool_thread(void* const argument) {
+    Buffer buffer;
+
+    if (buffer_pool_acquire(&shared_pool, &buffer, 1000, BUFFER_FLAG_NONE) != BUFFER_POOL_ERROR_NONE) return NULL;
+    buffer_pool_release(&shared_pool, &buffer);
+
+    pthread_barrier_wait(&pool_barrier);
+    pthread_barrier_wait(&pool_barrier);
+    buffer_pool_flush_cache(&shared_pool);
+
+    return argument;
+}
+
+TEST("buffer_pool_deinit waits until other threads have flushed their caches", {
+    pthread_t thread;
+    ASSERT_NONE(buffer_pool_init(&shared_pool));
+    ASSERT_NONE(pthread_barrier_init(&pool_barrier, NULL, 2));
+    ASSERT_NONE(pthread_create(&thread, NULL, pool_thread, NULL));
+
+    pthread_barrier_wait(&pool_barrier);
+    ASSERT_EQUAL(buffer_pool_deinit(&shared_pool), BUFFER_POOL_ERROR_THREAD_CACHES);
+    pthread_barrier_wait(&pool_barrier);
+
+    ASSERT_NONE(pthread_join(thread, NULL));
+    pthread_barrier_destroy(&pool_barrier);
+    ASSERT_EQUAL(shared_pool.caches, 0);
+    ASSERT_EQUAL(shared_pool.classes[CLASS_1024].cached, 1);
+    ASSERT_NONE(buffer_pool_deinit(&shared_pool));
+    ASSERT_EQUAL(shared_pool.classes[CLASS_1024].cached, 0);
+});
+
+int main(void) {
+    puts("This example tests the buffers. To run the tests, compile the program with the -DTESTS flag.");
+    return 0;
+}
@@ -0,0 +1,194 @@
+#ifndef SAFETYCT_ARENA_H
+#define SAFETYCT_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../safetyct.h"
+
+/*
+    Bump-pointer allocation out of large chunks. Everything allocated from an arena
+    is freed at once, which makes it a good fit for scoped lifetimes:
+
+        Arena arena;
+        CRASH_SOME(arena_init(&arena, ARENA_CHUNK_SIZE_DEFAULT));
+        DEFER(arena_release(&arena));
+
+        Header *headers = ARENA_ALLOC(&arena, count, Header);
+
+    The chunks are allocated with MALLOC, so in DEBUG mode a chunk that is never released
+    shows up in the leak report, at the MALLOC in `arena_alloc` and not at an ARENA_ALLOC.
+*/
+
+/**
+ * @name ARENA_CHUNK_SIZE_DEFAULT
+ * @brief A reasonable chunk size for `arena_init`.
+ */
+#define ARENA_CHUNK_SIZE_DEFAULT (64 * 1024)
+
+/**
+ * @name ARENA_ALLOC
+ * @brief Allocate `count` elements of `type` from the arena, like `MALLOC(count, type)`.
+ * @return A pointer to uninitialized memory, or NULL if a chunk could not be allocated
+ * or the size overflows.
+ */
+#define ARENA_ALLOC(arena, count, type)                                             \
+    ({                                                                              \
+        size_t scti_arena_size;                                                     \
+        __builtin_mul_overflow(sizeof(type), (count), &scti_arena_size)             \
+            ? NULL                                                                  \
+            : arena_alloc((arena), scti_arena_size, _Alignof(type));                \
+    })
+
+/**
+ * @name ArenaChunk
+ * @brief A chunk of memory that allocations are bumped out of.
+ * The chunks of an arena form a list from the newest to the oldest.
+ */
+typedef struct arena_chunk {
+    struct arena_chunk *next;           // The previous, older chunk.
+    size_t cap, len;                    // Capacity and used size of `data`.
+    _Alignas(max_align_t) unsigned char data[];
+} ArenaChunk;
+
+/**
+ * @name Arena
+ * @brief A bump-pointer allocator that frees all of its allocations at once.
+ */
+typedef struct arena {
+    ArenaChunk *chunk;                  // The newest chunk, NULL if nothing has been allocated.
+    size_t chunk_size;                  // Capacity of new chunks.
+} Arena;
+
+/**
+ * @name ArenaMark
+ * @brief A position in the arena to rewind back to.
+ */
+typedef struct arena_mark {
+    ArenaChunk *chunk;
+    size_t len;
+} ArenaMark;
+
+/**
+ * @name ArenaError
+ * @brief An enum that contains all the arena errors.
+ */
+typedef enum arena_error {
+    ARENA_ERROR_NONE,                   // No error.
+    ARENA_ERROR_NULL_ARENA,             // The `arena` pointer is null.
+    ARENA_ERROR_ZERO_CHUNK_SIZE,        // The provided chunk size is zero.
+    ARENA_ERROR_INVALID_MARK,           // The mark does not belong to the arena.
+} ArenaError;
+
+/**
+ * @name arena_init
+ * @brief Initialize an empty arena. The first chunk is allocated on the first allocation.
+ */
+__attribute__((warn_unused_result)) static inline ArenaError arena_init(
+    Arena* const arena,
+    size_t const chunk_size
+) {
+    if (arena == NULL) return ARENA_ERROR_NULL_ARENA;
+    if (chunk_size == 0) return ARENA_ERROR_ZERO_CHUNK_SIZE;
+
+    arena->chunk = NULL;
+    arena->chunk_size = chunk_size;
+
+    return ARENA_ERROR_NONE;
+}
+
+/**
+ * @name arena_alloc
+ * @brief Allocate `size` bytes aligned to `align`, which must be a power of two.
+ * Allocations that do not fit in a chunk get a chunk of their own.
+ * @return A pointer to uninitialized memory, or NULL on failure or if the size overflows.
+ */
+static inline void* arena_alloc(
+    Arena* const arena,
+    size_t const size,
+    size_t const align
+) {
+    ArenaChunk *chunk;
+    uintptr_t address, end;
+    size_t cap;
+
+    if (arena == NULL || align == 0 || (align & (align - 1)) != 0) return NULL;
+
+    chunk = arena->chunk;
+    if (chunk != NULL) {
+        address = ((uintptr_t)(chunk->data + chunk->len) + align - 1) & ~(uintptr_t)(align - 1);
+        end = (uintptr_t)(chunk->data + chunk->cap);
+        if (address <= end && size <= end - address) {
+            chunk->len = address + size - (uintptr_t)chunk->data;
+            return (void*)address;
+        }
+    }
+
+    if (size > SIZE_MAX - (align - 1)) return NULL;
+
+    cap = size + align - 1 > arena->chunk_size ? size + align - 1 : arena->chunk_size;
+    if (cap > SIZE_MAX - sizeof(ArenaChunk)) return NULL;
+
+    chunk = MALLOC(sizeof(ArenaChunk) + cap, unsigned char);
+    if (chunk == NULL) return NULL;
+
+    chunk->next = arena->chunk;
+    chunk->cap = cap;
+    arena->chunk = chunk;
+
+    address = ((uintptr_t)chunk->data + align - 1) & ~(uintptr_t)(align - 1);
+    chunk->len = address + size - (uintptr_t)chunk->data;
+
+    return (void*)address;
+}
+
+/**
+ * @name arena_mark
+ * @brief Get the current position of the arena.
+ */
+static inline ArenaMark arena_mark(Arena const* const arena) {
+    ArenaMark mark = {0};
+    if (arena != NULL && arena->chunk != NULL) {
+        mark.chunk = arena->chunk;
+        mark.len = arena->chunk->len;
+    }
+    return mark;
+}
+
+/**
+ * @name arena_rewind
+ * @brief Free everything allocated after the mark was taken.
+ */
+static inline ArenaError arena_rewind(
+    Arena* const arena,
+    ArenaMark const mark
+) {
+    if (arena == NULL) return ARENA_ERROR_NULL_ARENA;
+
+    // The mark is checked before anything is freed, so that a foreign mark leaves the arena intact.
+    if (mark.chunk != NULL) {
+        ArenaChunk const *chunk = arena->chunk;
+        while (chunk != NULL && chunk != mark.chunk) chunk = chunk->next;
+        if (chunk == NULL || mark.len > chunk->len) return ARENA_ERROR_INVALID_MARK;
+    }
+
+    while (arena->chunk != mark.chunk) {
+        ArenaChunk* const next = arena->chunk->next;
+        FREE(arena->chunk);
+        arena->chunk = next;
+    }
+
+    if (arena->chunk != NULL) arena->chunk->len = mark.len;
+
+    return ARENA_ERROR_NONE;
+}
+
+/**
+ * @name arena_release
+ * @brief Free all the chunks of the arena. The arena can be used again afterwards.
+ */
+static inline ArenaError arena_release(Arena* const arena) {
+    return arena_rewind(arena, (ArenaMark){0});
+}
+
+#endif
@@ -1,27 +1,95 @@
 #ifndef SAFETYCT_BUFFER_H
 #define SAFETYCT_BUFFER_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+/*
+    Static, dynamic and chained buffers only need the C standard library. The parts that
+    need the operating system are behind compiler options:
+
+        -DBUFFER_FD         `buffer_flush_fd`, which writes with `write` and `writev` (POSIX).
+        -DBUFFER_MAPPED     Mapped buffers, `buffer_init_mapped` (Linux). `mremap` and
+                            `MAP_ANONYMOUS` are only declared with -D_GNU_SOURCE, which must
+                            be given as well, before any header is included.
+*/
+
+#ifdef BUFFER_FD
+    #include <errno.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+
+    #define BUFFER_IOV_MAX 64           // Segments written by one `writev` call.
+#endif
+
+#ifdef BUFFER_MAPPED
+    #ifndef _GNU_SOURCE
+        #error "Mapped buffers need -D_GNU_SOURCE for mremap and MAP_ANONYMOUS"
+    #endif
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * @name BUFFER_SEGMENT_SIZE_DEFAULT
+ * @brief A reasonable segment size for `buffer_init_chained`.
+ */
+#define BUFFER_SEGMENT_SIZE_DEFAULT (64 * 1024)
+
 /**
  * @name BufferType
- * @brief The type of the buffer, static or dynamic.
+ * @brief The type of the buffer, static, dynamic, chained or mapped.
  */
 typedef enum buffer_type {
     BUFFER_TYPE_STATIC,     // The buffer capacity is static, and the buffer does not grow.
     BUFFER_TYPE_DYNAMIC,    // The buffer grows dynamically when needed.
+    BUFFER_TYPE_CHAINED,    // The buffer grows by linking segments, the written data is never moved.
+    BUFFER_TYPE_MAPPED,     // The buffer is a file or anonymous memory mapping that grows with `mremap` (-DBUFFER_MAPPED).
 } BufferType;
 
+/**
+ * @name BufferFlag
+ * @brief Flags that change how a buffer treats its memory, combined with `|`.
+ */
+typedef enum buffer_flag {
+    BUFFER_FLAG_NONE = 0,           // The unused capacity is kept zeroed.
+    BUFFER_FLAG_NO_ZERO = 1 << 0,   // Skip zeroing the capacity on init, clear and grow.
+    BUFFER_FLAG_HUGE_PAGES = 1 << 1,    // Ask for transparent huge pages for a mapped buffer.
+    BUFFER_FLAG_SEQUENTIAL = 1 << 2,    // Tell the kernel a mapped buffer is accessed sequentially.
+    BUFFER_FLAG_INLINE = 1 << 3,    // The data is still in the storage from `buffer_init_inline`, set and cleared by the buffer.
+} BufferFlag;
+
+/**
+ * @name BufferSegment
+ * @brief A segment of a chained buffer. The segment either owns its `data`, or refers
+ * to external memory that was attached with `buffer_attach_bytes`.
+ */
+typedef struct buffer_segment {
+    struct buffer_segment *next;
+    size_t cap, len;            // Capacity and used size of the segment.
+    unsigned char *ptr;         // Points to `data`, or to the attached memory.
+    int attached;               // The segment refers to attached memory.
+    unsigned char data[];
+} BufferSegment;
+
 /**
  * @name Buffer
  * @brief A multi-purpose buffer for writing bytes.
- * The buffer can be used as a dynamic or static buffer.
+ * The buffer can be used as a dynamic, static, chained or mapped buffer.
+ * The data of a chained buffer is in its segments from `head` to `tail`, not in `ptr`.
  */
 typedef struct buffer {
-    BufferType type;    // Type of the buffer, either static or dynamic.
+    BufferType type;    // Type of the buffer, either static, dynamic, chained or mapped.
+    unsigned flags;     // A combination of `BufferFlag`s.
     size_t cap, len;    // Capacity (total size) and length (used size).
-    void *ptr;          // Pointer to the underlying data.
+    void *ptr;          // Pointer to the underlying data, NULL for a chained buffer.
+    size_t reallocs;    // Number of times the dynamic buffer has been reallocated.
+    size_t moved;       // Bytes copied by the reallocations that moved the data.
+    BufferSegment *head, *tail;     // The segments of a chained buffer, the segments after `tail` are empty.
+    size_t segment_size;            // Capacity of new segments.
+    int fd;                         // The file of a mapped buffer, -1 for an anonymous mapping.
 } Buffer;
 
 /**
@@ -36,10 +104,43 @@ typedef enum buffer_error {
     BUFFER_ERROR_ZERO_CAPACITY, // The provided capacity is zero.
     BUFFER_ERROR_CALLOC_FAILED, // A call to `calloc` failed.
     BUFFER_ERROR_ZERO_COUNT,    // The specified count is zero.
-    BUFFER_ERROR_CAPACITY_FULL, // The buffer capacity is full.
+    BUFFER_ERROR_CAPACITY_FULL, // The buffer capacity is full, or the size does not fit in a `size_t`.
     BUFFER_ERROR_ZERO_SIZE,     // The specified size is zero.
+    BUFFER_ERROR_INVALID_TYPE,  // The operation is not supported by the buffer type.
+    BUFFER_ERROR_WRITE_FAILED,  // A call to `write` or `writev` failed.
+    BUFFER_ERROR_MMAP_FAILED,   // A call to `mmap`, `mremap` or `ftruncate` failed.
 } BufferError;
 
+/**
+ * @name buffer_init_dynamic_flags
+ * @brief Initialize a dynamic buffer with a specified capacity and `BufferFlag`s.
+ */
+__attribute__((warn_unused_result)) static BufferError buffer_init_dynamic_flags(
+    Buffer* const buffer,
+    size_t const capacity,
+    unsigned const flags
+) {
+    if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+    if (capacity == 0) return BUFFER_ERROR_ZERO_CAPACITY;
+
+    buffer->type = BUFFER_TYPE_DYNAMIC;
+    buffer->flags = flags;
+    buffer->cap = capacity;
+    buffer->len = 0;
+    buffer->ptr = flags & BUFFER_FLAG_NO_ZERO ? malloc(capacity) : calloc(1, capacity);
+    buffer->reallocs = 0;
+    buffer->moved = 0;
+    buffer->head = buffer->tail = NULL;
+    buffer->segment_size = 0;
+    buffer->fd = -1;
+
+    if (buffer->ptr == NULL) {
+        return BUFFER_ERROR_CALLOC_FAILED;
+    }
+
+    return BUFFER_ERROR_NONE;
+}
+
 /**
  * @name buffer_init_dynamic
  * @brief Initialize a dynamic buffer with a specified capacity.
@@ -47,18 +148,38 @@ typedef enum buffer_error {
 __attribute__((warn_unused_result)) static BufferError buffer_init_dynamic(
     Buffer* const buffer,
     size_t const capacity
+) {
+    return buffer_init_dynamic_flags(buffer, capacity, BUFFER_FLAG_NONE);
+}
+
+/**
+ * @name buffer_init_inline
+ * @brief Initialize a dynamic buffer that starts in `storage`, for example an array on the stack,
+ * and moves to the heap only when it outgrows it, so a short-lived small buffer allocates nothing.
+ * The storage must stay valid until the buffer is deinitialized, it is never freed by the buffer.
+ */
+static BufferError buffer_init_inline(
+    Buffer* const buffer,
+    void* const storage,
+    size_t const capacity,
+    unsigned const flags
 ) {
     if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+    if (storage == NULL) return BUFFER_ERROR_NULL_POINTER;
     if (capacity == 0) return BUFFER_ERROR_ZERO_CAPACITY;
 
     buffer->type = BUFFER_TYPE_DYNAMIC;
+    buffer->flags = flags | BUFFER_FLAG_INLINE;
     buffer->cap = capacity;
     buffer->len = 0;
-    buffer->ptr = calloc(1, capacity);
+    buffer->ptr = storage;
+    buffer->reallocs = 0;
+    buffer->moved = 0;
+    buffer->head = buffer->tail = NULL;
+    buffer->segment_size = 0;
+    buffer->fd = -1;
 
-    if (buffer->ptr == NULL) {
-        return BUFFER_ERROR_CALLOC_FAILED;
-    }
+    if (!(flags & BUFFER_FLAG_NO_ZERO)) memset(storage, 0, capacity);
 
     return BUFFER_ERROR_NONE;
 }
@@ -77,44 +198,239 @@ static BufferError buffer_init_static(
     if (capacity == 0) return BUFFER_ERROR_ZERO_CAPACITY;
 
     buffer->type = BUFFER_TYPE_STATIC;
+    buffer->flags = BUFFER_FLAG_NONE;
     buffer->cap = capacity;
     buffer->len = 0;
     buffer->ptr = pointer;
+    buffer->reallocs = 0;
+    buffer->moved = 0;
+    buffer->head = buffer->tail = NULL;
+    buffer->segment_size = 0;
+    buffer->fd = -1;
 
     memset(pointer, 0, capacity);
 
     return BUFFER_ERROR_NONE;
 }
 
+/**
+ * @name buffer_init_chained
+ * @brief Initialize a chained buffer that grows by `segment_size` bytes at a time.
+ * The first segment is allocated on the first write.
+ */
+__attribute__((warn_unused_result)) static BufferError buffer_init_chained(
+    Buffer* const buffer,
+    size_t const segment_size,
+    unsigned const flags
+) {
+    if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+    if (segment_size == 0) return BUFFER_ERROR_ZERO_CAPACITY;
+
+    buffer->type = BUFFER_TYPE_CHAINED;
+    buffer->flags = flags;
+    buffer->cap = 0;
+    buffer->len = 0;
+    buffer->ptr = NULL;
+    buffer->reallocs = 0;
+    buffer->moved = 0;
+    buffer->head = buffer->tail = NULL;
+    buffer->segment_size = segment_size;
+    buffer->fd = -1;
+
+    return BUFFER_ERROR_NONE;
+}
+
+#ifdef BUFFER_MAPPED
+
+/**
+ * @name buffer_advise
+ * @brief Pass the hints of the flags of a mapped buffer to the kernel.
+ */
+static void buffer_advise(Buffer const* const buffer) {
+#ifdef MADV_HUGEPAGE
+    if (buffer->flags & BUFFER_FLAG_HUGE_PAGES) madvise(buffer->ptr, buffer->cap, MADV_HUGEPAGE);
+#endif
+    if (buffer->flags & BUFFER_FLAG_SEQUENTIAL) madvise(buffer->ptr, buffer->cap, MADV_SEQUENTIAL);
+}
+
+/**
+ * @name buffer_init_mapped
+ * @brief Initialize a buffer that maps the file `fd` or, if `fd` is -1, anonymous memory.
+ * The file is resized to `capacity`, and to `len` when the buffer is deinitialized.
+ * The buffer does not close the file. New capacity is always zeroed by the kernel.
+ */
+__attribute__((warn_unused_result)) static BufferError buffer_init_mapped(
+    Buffer* const buffer,
+    int const fd,
+    size_t const capacity,
+    unsigned const flags
+) {
+    if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+    if (capacity == 0) return BUFFER_ERROR_ZERO_CAPACITY;
+    if (fd != -1 && ftruncate(fd, capacity) != 0) return BUFFER_ERROR_MMAP_FAILED;
+
+    void* const ptr = fd == -1
+        ? mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+        : mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) return BUFFER_ERROR_MMAP_FAILED;
+
+    buffer->type = BUFFER_TYPE_MAPPED;
+    buffer->flags = flags;
+    buffer->cap = capacity;
+    buffer->len = 0;
+    buffer->ptr = ptr;
+    buffer->reallocs = 0;
+    buffer->moved = 0;
+    buffer->head = buffer->tail = NULL;
+    buffer->segment_size = 0;
+    buffer->fd = fd;
+
+    buffer_advise(buffer);
+
+    return BUFFER_ERROR_NONE;
+}
+
+#endif
+
+/**
+ * @name buffer_chain_extend
+ * @brief Move the tail of a chained buffer to a segment with room for `size` bytes.
+ * An empty segment after the tail is reused if it is large enough.
+ */
+static BufferError buffer_chain_extend(
+    Buffer* const buffer,
+    size_t const size
+) {
+    BufferSegment *next = buffer->tail != NULL ? buffer->tail->next : buffer->head;
+
+    if (next == NULL || next->cap < size) {
+        size_t const cap = size > buffer->segment_size ? size : buffer->segment_size;
+        if (cap > SIZE_MAX - sizeof(BufferSegment)) return BUFFER_ERROR_CAPACITY_FULL;
+        BufferSegment* const segment = buffer->flags & BUFFER_FLAG_NO_ZERO
+            ? malloc(sizeof(BufferSegment) + cap)
+            : calloc(1, sizeof(BufferSegment) + cap);
+        if (segment == NULL) return BUFFER_ERROR_CALLOC_FAILED;
+
+        segment->next = next;
+        segment->cap = cap;
+        segment->len = 0;
+        segment->ptr = segment->data;
+        segment->attached = 0;
+        if (buffer->tail != NULL) buffer->tail->next = segment;
+        else buffer->head = segment;
+        buffer->cap += cap;
+        next = segment;
+    }
+
+    buffer->tail = next;
+
+    return BUFFER_ERROR_NONE;
+}
+
+/**
+ * @name buffer_chain_write
+ * @brief Copy bytes to the end of a chained buffer, filling the tail segment before linking a new one.
+ */
+static BufferError buffer_chain_write(
+    Buffer* const buffer,
+    void const* const pointer,
+    size_t const size
+) {
+    unsigned char const *bytes = pointer;
+    size_t left = size;
+
+    while (left > 0) {
+        if (buffer->tail == NULL || buffer->tail->len == buffer->tail->cap) {
+            BufferError error = buffer_chain_extend(buffer, 1);
+            if (error != BUFFER_ERROR_NONE) return error;
+        }
+
+        BufferSegment* const tail = buffer->tail;
+        size_t const count = tail->cap - tail->len < left ? tail->cap - tail->len : left;
+        memcpy(tail->ptr + tail->len, bytes, count);
+        tail->len += count;
+        buffer->len += count;
+        bytes += count;
+        left -= count;
+    }
+
+    return BUFFER_ERROR_NONE;
+}
+
 /**
  * @name buffer_clear
  * @brief Clear the buffer of all of its contents and set `len` to 0.
  */
 static BufferError buffer_clear(Buffer* const buffer) {
     if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+    size_t const length = buffer->len;
     buffer->len = 0;
-    memset(buffer->ptr, 0, buffer->cap);
+
+    if (buffer->type == BUFFER_TYPE_CHAINED) {
+        // Attached segments are dropped, the own segments are kept for the next writes.
+        BufferSegment **link = &buffer->head;
+        while (*link != NULL) {
+            BufferSegment* const segment = *link;
+            if (segment->attached) {
+                *link = segment->next;
+                buffer->cap -= segment->cap;
+                free(segment);
+                continue;
+            }
+            if (!(buffer->flags & BUFFER_FLAG_NO_ZERO)) {
+                memset(segment->data, 0, segment->len);
+            }
+            segment->len = 0;
+            link = &segment->next;
+        }
+        buffer->tail = buffer->head;
+        return BUFFER_ERROR_NONE;
+    }
+
+    // Only the written part of a mapped buffer is zeroed, so that pages are not faulted in.
+    if (!(buffer->flags & BUFFER_FLAG_NO_ZERO)) {
+        memset(buffer->ptr, 0, buffer->type == BUFFER_TYPE_MAPPED ? length : buffer->cap);
+    }
     return BUFFER_ERROR_NONE;
 }
 
 /**
  * @name buffer_deinit
- * @brief Clear the buffer and free its memory if the buffer is dynamic.
+ * @brief Clear the buffer and free its memory if the buffer is dynamic or chained.
+ * A mapped buffer is not cleared, the file is synced and truncated to `len` before it is unmapped.
  */
 static BufferError buffer_deinit(Buffer* const buffer) {
     if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+#ifdef BUFFER_MAPPED
+    if (buffer->type == BUFFER_TYPE_MAPPED) {
+        BufferError result = BUFFER_ERROR_NONE;
+        if (buffer->fd != -1 && msync(buffer->ptr, buffer->cap, MS_SYNC) != 0) result = BUFFER_ERROR_MMAP_FAILED;
+        if (munmap(buffer->ptr, buffer->cap) != 0) result = BUFFER_ERROR_MMAP_FAILED;
+        if (buffer->fd != -1 && ftruncate(buffer->fd, buffer->len) != 0) result = BUFFER_ERROR_MMAP_FAILED;
+        buffer->ptr = NULL;
+        buffer->cap = buffer->len = 0;
+        return result;
+    }
+#endif
     BufferError error = buffer_clear(buffer);
     if (error != BUFFER_ERROR_NONE) return error;
-    buffer_clear(buffer);
-    if (buffer->type == BUFFER_TYPE_DYNAMIC) {
+    if (buffer->type == BUFFER_TYPE_DYNAMIC && !(buffer->flags & BUFFER_FLAG_INLINE)) {
         free(buffer->ptr);
     }
+    while (buffer->head != NULL) {
+        BufferSegment* const next = buffer->head->next;
+        free(buffer->head);
+        buffer->head = next;
+    }
+    buffer->tail = NULL;
+    buffer->cap = 0;
     return BUFFER_ERROR_NONE;
 }
 
 /**
  * @name buffer_grow
  * @brief Grow the buffer to match the specified capacity.
+ * The new capacity is zeroed after `len` unless the buffer has `BUFFER_FLAG_NO_ZERO`.
  */
 static BufferError buffer_grow(
     Buffer* const buffer,
@@ -122,40 +438,129 @@ static BufferError buffer_grow(
 ) {
     if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
     if (buffer->type == BUFFER_TYPE_STATIC || buffer->cap > capacity) return BUFFER_ERROR_NONE;
+    if (buffer->type == BUFFER_TYPE_CHAINED) return buffer_chain_extend(buffer, capacity - buffer->len);
+
+    // A buffer without memory, like one released to a buffer pool, starts over from one byte.
+    size_t cap = buffer->cap != 0 ? buffer->cap : 1;
+    while (cap <= capacity) {
+        if (cap > SIZE_MAX / 2) return BUFFER_ERROR_CAPACITY_FULL;
+        cap <<= 1;
+    }
+
+#ifdef BUFFER_MAPPED
+    // The pages of a mapping are moved by the kernel without copying, and the new ones are zero.
+    if (buffer->type == BUFFER_TYPE_MAPPED) {
+        if (buffer->fd != -1 && ftruncate(buffer->fd, cap) != 0) return BUFFER_ERROR_MMAP_FAILED;
+        void* const ptr = mremap(buffer->ptr, buffer->cap, cap, MREMAP_MAYMOVE);
+        if (ptr == MAP_FAILED) {
+            // The file goes back to the size of the mapping, so that it is not left extended.
+            if (buffer->fd != -1) {
+                int const truncated = ftruncate(buffer->fd, buffer->cap);
+                (void) truncated;
+            }
+            return BUFFER_ERROR_MMAP_FAILED;
+        }
+
+        buffer->reallocs += 1;
+        buffer->ptr = ptr;
+        buffer->cap = cap;
+        buffer_advise(buffer);
+        return BUFFER_ERROR_NONE;
+    }
+#endif
 
-    while (buffer->cap <= capacity) buffer->cap <<= 1;
+    // A buffer that outgrows the storage from `buffer_init_inline` moves to the heap.
+    int const spill = buffer->flags & BUFFER_FLAG_INLINE;
+    void* const ptr = spill ? malloc(cap) : realloc(buffer->ptr, cap);
+    if (ptr == NULL) return BUFFER_ERROR_CALLOC_FAILED;
+    if (spill) memcpy(ptr, buffer->ptr, buffer->len);
+    buffer->flags &= ~BUFFER_FLAG_INLINE;
 
-    buffer->ptr = realloc(buffer->ptr, buffer->cap);
-    if (buffer->ptr == NULL) return BUFFER_ERROR_CALLOC_FAILED;
-    memset(buffer->ptr + buffer->len, 0, buffer->cap - buffer->len);
+    buffer->reallocs += 1;
+    if (ptr != buffer->ptr) buffer->moved += buffer->len;
+    buffer->ptr = ptr;
+    buffer->cap = cap;
+
+    if (!(buffer->flags & BUFFER_FLAG_NO_ZERO)) {
+        memset((char*)buffer->ptr + buffer->len, 0, buffer->cap - buffer->len);
+    }
 
     return BUFFER_ERROR_NONE;
 }
 
 /**
- * @name buffer_write_byte
- * @brief Write a single byte into the buffer.
+ * @name buffer_reserve
+ * @brief Make room for `size` more bytes and get a pointer to them in `space`.
+ * The bytes are not zeroed or counted in `len` until they are committed with `buffer_commit`.
+ * The pointer is valid until the buffer grows again.
  */
-static BufferError buffer_write_byte(
+static BufferError buffer_reserve(
     Buffer* const buffer,
-    unsigned char const byte
+    size_t const size,
+    void** const space
 ) {
     if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+    if (space == NULL) return BUFFER_ERROR_NULL_POINTER;
+    if (size > SIZE_MAX - buffer->len) return BUFFER_ERROR_CAPACITY_FULL;
+
+    if (buffer->type == BUFFER_TYPE_CHAINED) {
+        if (buffer->tail == NULL || buffer->tail->cap - buffer->tail->len < size) {
+            BufferError error = buffer_chain_extend(buffer, size);
+            if (error != BUFFER_ERROR_NONE) return error;
+        }
+        *space = buffer->tail->ptr + buffer->tail->len;
+        return BUFFER_ERROR_NONE;
+    }
 
-    if (buffer->type == BUFFER_TYPE_DYNAMIC) {
-        BufferError error = buffer_grow(buffer, buffer->len + 1);
+    if (buffer->len + size >= buffer->cap) {
+        if (buffer->type == BUFFER_TYPE_STATIC) return BUFFER_ERROR_CAPACITY_FULL;
+        BufferError error = buffer_grow(buffer, buffer->len + size);
         if (error != BUFFER_ERROR_NONE) return error;
+    }
+
+    *space = (char*)buffer->ptr + buffer->len;
+
+    return BUFFER_ERROR_NONE;
+}
 
-    } else if (buffer->len + 1 >= buffer->cap) {
+/**
+ * @name buffer_commit
+ * @brief Add `size` bytes written to the space from `buffer_reserve` to `len`.
+ */
+static BufferError buffer_commit(
+    Buffer* const buffer,
+    size_t const size
+) {
+    if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+
+    if (buffer->type == BUFFER_TYPE_CHAINED) {
+        if (buffer->tail == NULL || size > buffer->tail->cap - buffer->tail->len) return BUFFER_ERROR_CAPACITY_FULL;
+        buffer->tail->len += size;
+    } else if (size >= buffer->cap - buffer->len) {
         return BUFFER_ERROR_CAPACITY_FULL;
     }
 
-    ((char*)buffer->ptr)[buffer->len] = byte;
-    buffer->len += 1;
+    buffer->len += size;
 
     return BUFFER_ERROR_NONE;
 }
 
+/**
+ * @name buffer_write_byte
+ * @brief Write a single byte into the buffer.
+ */
+static BufferError buffer_write_byte(
+    Buffer* const buffer,
+    unsigned char const byte
+) {
+    void *space;
+    BufferError error = buffer_reserve(buffer, 1, &space);
+    if (error != BUFFER_ERROR_NONE) return error;
+
+    *(unsigned char*)space = byte;
+    return buffer_commit(buffer, 1);
+}
+
 /**
  * @name buffer_write_bytes
  * @brief Write a specified amount of bytes into the buffer.
@@ -168,19 +573,14 @@ static BufferError buffer_write_bytes(
     if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
     if (bytes == NULL) return BUFFER_ERROR_NULL_BYTES;
     if (count == 0) return BUFFER_ERROR_ZERO_COUNT;
+    if (buffer->type == BUFFER_TYPE_CHAINED) return buffer_chain_write(buffer, bytes, count);
 
-    if (buffer->type == BUFFER_TYPE_DYNAMIC) {
-        BufferError error = buffer_grow(buffer, buffer->len + count);
-        if (error != BUFFER_ERROR_NONE) return error;
-
-    } else if (buffer->len + count >= buffer->cap) {
-        return BUFFER_ERROR_CAPACITY_FULL;
-    }
+    void *space;
+    BufferError error = buffer_reserve(buffer, count, &space);
+    if (error != BUFFER_ERROR_NONE) return error;
 
-    for (size_t i = 0; i < count; i += 1) {
-        ((char*)buffer->ptr)[buffer->len] = bytes[i];
-        buffer->len += 1;
-    }
+    memcpy(space, bytes, count);
+    buffer->len += count;
 
     return BUFFER_ERROR_NONE;
 }
@@ -209,19 +609,117 @@ static BufferError buffer_copy_bytes(
     if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
     if (pointer == NULL) return BUFFER_ERROR_NULL_POINTER;
     if (size == 0) return BUFFER_ERROR_ZERO_SIZE;
+    if (buffer->type == BUFFER_TYPE_CHAINED) return buffer_chain_write(buffer, pointer, size);
 
-    if (buffer->type == BUFFER_TYPE_DYNAMIC) {
-        BufferError error = buffer_grow(buffer, buffer->len + size);
-        if (error != BUFFER_ERROR_NONE) return error;
+    void *space;
+    BufferError error = buffer_reserve(buffer, size, &space);
+    if (error != BUFFER_ERROR_NONE) return error;
 
-    } else if (buffer->len + size >= buffer->cap) {
-        return BUFFER_ERROR_CAPACITY_FULL;
-    }
+    memcpy(space, pointer, size);
+    buffer->len += size;
 
-    memcpy(buffer->ptr + buffer->len, pointer, size);
+    return BUFFER_ERROR_NONE;
+}
+
+/**
+ * @name buffer_attach_bytes
+ * @brief Append external memory to a chained buffer by reference, without copying it.
+ * The memory must stay valid until the buffer is flushed, cleared or deinitialized.
+ */
+static BufferError buffer_attach_bytes(
+    Buffer* const buffer,
+    void* const pointer,
+    size_t const size
+) {
+    if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+    if (pointer == NULL) return BUFFER_ERROR_NULL_POINTER;
+    if (size == 0) return BUFFER_ERROR_ZERO_SIZE;
+    if (buffer->type != BUFFER_TYPE_CHAINED) return BUFFER_ERROR_INVALID_TYPE;
+
+    BufferSegment* const segment = malloc(sizeof(BufferSegment));
+    if (segment == NULL) return BUFFER_ERROR_CALLOC_FAILED;
+
+    segment->cap = size;
+    segment->len = size;
+    segment->ptr = pointer;
+    segment->attached = 1;
+
+    // The attached segment goes right after the tail, in front of the empty segments.
+    if (buffer->tail != NULL) {
+        segment->next = buffer->tail->next;
+        buffer->tail->next = segment;
+    } else {
+        segment->next = buffer->head;
+        buffer->head = segment;
+    }
+    buffer->tail = segment;
+    buffer->cap += size;
     buffer->len += size;
 
     return BUFFER_ERROR_NONE;
 }
 
+#ifdef BUFFER_FD
+
+/**
+ * @name buffer_flush_fd
+ * @brief Write the contents of the buffer to a file descriptor and clear the buffer.
+ * The segments of a chained buffer are written with `writev`, up to `BUFFER_IOV_MAX` per call.
+ * If writing fails, the buffer is left as it is.
+ */
+static BufferError buffer_flush_fd(
+    Buffer* const buffer,
+    int const fd
+) {
+    struct iovec vectors[BUFFER_IOV_MAX];
+    BufferSegment *segment;
+    size_t offset = 0;
+
+    if (buffer == NULL) return BUFFER_ERROR_NULL_BUFFER;
+
+    if (buffer->type != BUFFER_TYPE_CHAINED) {
+        while (offset < buffer->len) {
+            ssize_t const written = write(fd, (char*)buffer->ptr + offset, buffer->len - offset);
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0) return BUFFER_ERROR_WRITE_FAILED;
+            offset += written;
+        }
+        return buffer_clear(buffer);
+    }
+
+    segment = buffer->head;
+    while (segment != NULL) {
+        BufferSegment *next = segment;
+        size_t next_offset = offset;
+        int count = 0;
+
+        while (next != NULL && count < BUFFER_IOV_MAX) {
+            if (next->len > next_offset) {
+                vectors[count].iov_base = next->ptr + next_offset;
+                vectors[count].iov_len = next->len - next_offset;
+                count += 1;
+            }
+            next_offset = 0;
+            next = next->next;
+        }
+        if (count == 0) break;
+
+        ssize_t written = writev(fd, vectors, count);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) return BUFFER_ERROR_WRITE_FAILED;
+
+        // Skip the segments that were written completely, the rest of a partial one is written next.
+        while (segment != NULL && (size_t)written >= segment->len - offset) {
+            written -= segment->len - offset;
+            offset = 0;
+            segment = segment->next;
+        }
+        if (segment != NULL) offset += written;
+    }
+
+    return buffer_clear(buffer);
+}
+
+#endif
+
 #endif
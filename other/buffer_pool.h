@@ -0,0 +1,416 @@
+#ifndef SAFETYCT_BUFFER_POOL_H
+#define SAFETYCT_BUFFER_POOL_H
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+
+/*
+    Recycles the memory of dynamic buffers that are created and destroyed over and over,
+    like the buffers of a request loop:
+
+        BufferPool pool;
+        buffer_pool_init(&pool);
+
+        Buffer response;
+        if (buffer_pool_acquire(&pool, &response, 4096, BUFFER_FLAG_NO_ZERO) != BUFFER_POOL_ERROR_NONE) ...
+        buffer_write_string(&response, "...");
+        buffer_pool_release(&pool, &response);
+
+        buffer_pool_trim(&pool);    // Every now and then, for example after every 1000 requests.
+        buffer_pool_deinit(&pool);
+
+    The memory is kept in free lists of power-of-two size classes. A buffer may grow while
+    it is in use, it is returned to the class of its capacity when it is released.
+    A buffer from `buffer_init_inline` can be released too, its memory only goes to the pool
+    once it has moved to the heap.
+
+    A pool is not thread-safe by default. Compile with -DBUFFER_POOL_THREAD_CACHE to make it
+    thread-safe, every thread then keeps a few blocks of every class in a cache of its own
+    and only locks the pool to move a batch of them. Every other thread that used the pool
+    before it is deinitialized has to give its cache back with `buffer_pool_flush_cache` first.
+*/
+
+/**
+ * @name BUFFER_POOL_CLASS_MIN_SHIFT
+ * @brief The smallest size class is `1 << BUFFER_POOL_CLASS_MIN_SHIFT` bytes.
+ */
+#ifndef BUFFER_POOL_CLASS_MIN_SHIFT
+    #define BUFFER_POOL_CLASS_MIN_SHIFT 7
+#endif
+
+/**
+ * @name BUFFER_POOL_CLASS_MAX_SHIFT
+ * @brief The largest size class, larger buffers are allocated and freed as usual.
+ */
+#ifndef BUFFER_POOL_CLASS_MAX_SHIFT
+    #define BUFFER_POOL_CLASS_MAX_SHIFT 24
+#endif
+
+#define BUFFER_POOL_CLASS_COUNT (BUFFER_POOL_CLASS_MAX_SHIFT - BUFFER_POOL_CLASS_MIN_SHIFT + 1)
+
+/**
+ * @name BufferPoolBlock
+ * @brief A free block, the link of the free list is stored in the block itself.
+ */
+typedef struct buffer_pool_block {
+    struct buffer_pool_block *next;
+} BufferPoolBlock;
+
+/**
+ * @name BufferPoolClass
+ * @brief The free blocks of one size class.
+ */
+typedef struct buffer_pool_class {
+    BufferPoolBlock *free;
+    size_t cached;                      // Blocks in `free`.
+    size_t idle;                        // The fewest blocks in `free` since the last trim.
+} BufferPoolClass;
+
+/**
+ * @name BufferPool
+ * @brief Free lists of buffer memory by size class.
+ */
+typedef struct buffer_pool {
+    BufferPoolClass classes[BUFFER_POOL_CLASS_COUNT];
+    unsigned long long id;              // Identifies the pool in the thread caches.
+    int lock;
+    int caches;                         // Thread caches that hold a slot for the pool.
+} BufferPool;
+
+/**
+ * @name BufferPoolError
+ * @brief An enum that contains all the buffer pool errors.
+ */
+typedef enum buffer_pool_error {
+    BUFFER_POOL_ERROR_NONE,             // No error.
+    BUFFER_POOL_ERROR_NULL_POOL,        // The `pool` pointer is null.
+    BUFFER_POOL_ERROR_NULL_BUFFER,      // The `buffer` pointer is null.
+    BUFFER_POOL_ERROR_ZERO_CAPACITY,    // The provided capacity is zero.
+    BUFFER_POOL_ERROR_MALLOC_FAILED,    // A call to `malloc` failed.
+    BUFFER_POOL_ERROR_INVALID_TYPE,     // The buffer is not a dynamic buffer.
+    BUFFER_POOL_ERROR_THREAD_CACHES,    // Other threads have not flushed their caches of the pool.
+} BufferPoolError;
+
+__attribute__ ((weak)) unsigned long long buffer_pool_next_id;  // The id of the latest initialized pool.
+
+/**
+ * @name buffer_pool_init
+ * @brief Initialize an empty pool.
+ */
+__attribute__((warn_unused_result)) static inline BufferPoolError buffer_pool_init(BufferPool* const pool) {
+    if (pool == NULL) return BUFFER_POOL_ERROR_NULL_POOL;
+
+    memset(pool->classes, 0, sizeof(pool->classes));
+    pool->id = __atomic_add_fetch(&buffer_pool_next_id, 1, __ATOMIC_RELAXED);
+    pool->lock = 0;
+    pool->caches = 0;
+
+    return BUFFER_POOL_ERROR_NONE;
+}
+
+// Take a block from the free list of a class, or NULL if it is empty.
+// The pool must be locked if it is shared between threads.
+static inline BufferPoolBlock* buffer_pool_pop(BufferPool* const pool, unsigned const index) {
+    BufferPoolClass* const class = &pool->classes[index];
+    BufferPoolBlock* const block = class->free;
+
+    if (block != NULL) {
+        class->free = block->next;
+        class->cached -= 1;
+        if (class->cached < class->idle) class->idle = class->cached;
+    }
+
+    return block;
+}
+
+// Put a block on the free list of a class. The pool must be locked if it is shared between threads.
+static inline void buffer_pool_push(BufferPool* const pool, unsigned const index, BufferPoolBlock* const block) {
+    BufferPoolClass* const class = &pool->classes[index];
+
+    block->next = class->free;
+    class->free = block;
+    class->cached += 1;
+}
+
+#ifdef BUFFER_POOL_THREAD_CACHE
+
+    #ifndef BUFFER_POOL_THREAD_CACHE_SIZE
+        #define BUFFER_POOL_THREAD_CACHE_SIZE 8     // Blocks of a class a thread keeps before returning half of them.
+    #endif
+
+    #define BUFFER_POOL_THREAD_CACHE_SLOTS 4        // Pools a thread can cache blocks of at the same time.
+
+    /**
+     * @name BufferPoolCache
+     * @brief The blocks a thread has cached for the pool with the id `id`.
+     * The slot is only used for another pool once it is empty.
+     */
+    typedef struct buffer_pool_cache {
+        unsigned long long id;
+        BufferPool *pool;               // The pool whose `caches` counts the slot.
+        size_t total;
+        BufferPoolBlock *free[BUFFER_POOL_CLASS_COUNT];
+        unsigned count[BUFFER_POOL_CLASS_COUNT];
+    } BufferPoolCache;
+
+    _Thread_local BufferPoolCache buffer_pool_thread_caches[BUFFER_POOL_THREAD_CACHE_SLOTS] __attribute__ ((weak));
+
+    static inline void buffer_pool_lock(BufferPool* const pool) {
+        for (int spins = 0; __atomic_exchange_n(&pool->lock, 1, __ATOMIC_ACQUIRE); spins += 1) {
+            if (spins >= 100) {
+                sched_yield();
+            }
+        }
+    }
+
+    static inline void buffer_pool_unlock(BufferPool* const pool) {
+        __atomic_store_n(&pool->lock, 0, __ATOMIC_RELEASE);
+    }
+
+    // The cache slot of the pool, or NULL if the slot is taken by another pool.
+    static inline BufferPoolCache* buffer_pool_cache(BufferPool* const pool) {
+        BufferPoolCache* const cache = &buffer_pool_thread_caches[pool->id % BUFFER_POOL_THREAD_CACHE_SLOTS];
+
+        if (cache->id != pool->id) {
+            if (cache->total != 0) return NULL;
+            if (cache->pool != NULL) {
+                __atomic_sub_fetch(&cache->pool->caches, 1, __ATOMIC_RELEASE);
+            }
+            __atomic_add_fetch(&pool->caches, 1, __ATOMIC_ACQUIRE);
+            memset(cache, 0, sizeof(*cache));
+            cache->id = pool->id;
+            cache->pool = pool;
+        }
+
+        return cache;
+    }
+
+    static inline BufferPoolBlock* buffer_pool_take(BufferPool* const pool, unsigned const index) {
+        BufferPoolCache* const cache = buffer_pool_cache(pool);
+        BufferPoolBlock *block;
+
+        if (cache != NULL && cache->free[index] != NULL) {
+            block = cache->free[index];
+            cache->free[index] = block->next;
+            cache->count[index] -= 1;
+            cache->total -= 1;
+            return block;
+        }
+
+        buffer_pool_lock(pool);
+        block = buffer_pool_pop(pool, index);
+        while (cache != NULL && block != NULL && cache->count[index] < BUFFER_POOL_THREAD_CACHE_SIZE / 2) {
+            BufferPoolBlock* const extra = buffer_pool_pop(pool, index);
+            if (extra == NULL) break;
+            extra->next = cache->free[index];
+            cache->free[index] = extra;
+            cache->count[index] += 1;
+            cache->total += 1;
+        }
+        buffer_pool_unlock(pool);
+
+        return block;
+    }
+
+    static inline void buffer_pool_give(BufferPool* const pool, unsigned const index, BufferPoolBlock* const block) {
+        BufferPoolCache* const cache = buffer_pool_cache(pool);
+
+        if (cache != NULL && cache->count[index] < BUFFER_POOL_THREAD_CACHE_SIZE) {
+            block->next = cache->free[index];
+            cache->free[index] = block;
+            cache->count[index] += 1;
+            cache->total += 1;
+            return;
+        }
+
+        buffer_pool_lock(pool);
+        buffer_pool_push(pool, index, block);
+        while (cache != NULL && cache->count[index] > BUFFER_POOL_THREAD_CACHE_SIZE / 2) {
+            BufferPoolBlock* const extra = cache->free[index];
+            cache->free[index] = extra->next;
+            cache->count[index] -= 1;
+            cache->total -= 1;
+            buffer_pool_push(pool, index, extra);
+        }
+        buffer_pool_unlock(pool);
+    }
+
+    /**
+     * @name buffer_pool_flush_cache
+     * @brief Return the blocks the calling thread has cached to the pool and give up its slot.
+     * A thread should call this before it exits, or its cached blocks are leaked, and every
+     * thread that used the pool has to call this before another thread can deinitialize it.
+     */
+    static inline void buffer_pool_flush_cache(BufferPool* const pool) {
+        BufferPoolCache* const cache = &buffer_pool_thread_caches[pool->id % BUFFER_POOL_THREAD_CACHE_SLOTS];
+
+        if (cache->id != pool->id) return;
+
+        buffer_pool_lock(pool);
+        for (unsigned index = 0; index < BUFFER_POOL_CLASS_COUNT; index += 1) {
+            while (cache->free[index] != NULL) {
+                BufferPoolBlock* const block = cache->free[index];
+                cache->free[index] = block->next;
+                buffer_pool_push(pool, index, block);
+            }
+            cache->count[index] = 0;
+        }
+        buffer_pool_unlock(pool);
+
+        cache->id = 0;
+        cache->pool = NULL;
+        cache->total = 0;
+        __atomic_sub_fetch(&pool->caches, 1, __ATOMIC_RELEASE);
+    }
+
+#else
+
+    #define buffer_pool_lock(pool) ((void) (pool))
+    #define buffer_pool_unlock(pool) ((void) (pool))
+    #define buffer_pool_take(pool, index) buffer_pool_pop((pool), (index))
+    #define buffer_pool_give(pool, index, block) buffer_pool_push((pool), (index), (block))
+    #define buffer_pool_flush_cache(pool) ((void) (pool))
+
+#endif
+
+/**
+ * @name buffer_pool_acquire
+ * @brief Initialize a dynamic buffer with at least `capacity` bytes of memory from the pool.
+ * Reused memory is zeroed unless the flags contain `BUFFER_FLAG_NO_ZERO`.
+ */
+__attribute__((warn_unused_result)) static inline BufferPoolError buffer_pool_acquire(
+    BufferPool* const pool,
+    Buffer* const buffer,
+    size_t const capacity,
+    unsigned const flags
+) {
+    if (pool == NULL) return BUFFER_POOL_ERROR_NULL_POOL;
+    if (buffer == NULL) return BUFFER_POOL_ERROR_NULL_BUFFER;
+    if (capacity == 0) return BUFFER_POOL_ERROR_ZERO_CAPACITY;
+
+    // The smallest class with room for `capacity` bytes.
+    unsigned const shift = capacity <= (1ULL << BUFFER_POOL_CLASS_MIN_SHIFT)
+        ? BUFFER_POOL_CLASS_MIN_SHIFT
+        : 64 - __builtin_clzll(capacity - 1);
+
+    if (shift > BUFFER_POOL_CLASS_MAX_SHIFT) {
+        BufferError const error = buffer_init_dynamic_flags(buffer, capacity, flags);
+        return error == BUFFER_ERROR_NONE ? BUFFER_POOL_ERROR_NONE : BUFFER_POOL_ERROR_MALLOC_FAILED;
+    }
+
+    size_t const size = (size_t)1 << shift;
+    void *ptr = buffer_pool_take(pool, shift - BUFFER_POOL_CLASS_MIN_SHIFT);
+    if (ptr == NULL) {
+        ptr = malloc(size);
+        if (ptr == NULL) return BUFFER_POOL_ERROR_MALLOC_FAILED;
+    }
+    if (!(flags & BUFFER_FLAG_NO_ZERO)) memset(ptr, 0, size);
+
+    buffer->type = BUFFER_TYPE_DYNAMIC;
+    buffer->flags = flags;
+    buffer->cap = size;
+    buffer->len = 0;
+    buffer->ptr = ptr;
+    buffer->reallocs = 0;
+    buffer->moved = 0;
+    buffer->head = buffer->tail = NULL;
+    buffer->segment_size = 0;
+    buffer->fd = -1;
+
+    return BUFFER_POOL_ERROR_NONE;
+}
+
+/**
+ * @name buffer_pool_release
+ * @brief Return the memory of a dynamic buffer to the pool instead of freeing it with `buffer_deinit`.
+ * The memory goes to the largest class that fits in its capacity, memory that is smaller
+ * or larger than every class is freed. The buffer is left empty and without memory,
+ * writing to it allocates new memory, and `buffer_deinit` frees that as usual.
+ */
+static inline BufferPoolError buffer_pool_release(
+    BufferPool* const pool,
+    Buffer* const buffer
+) {
+    if (pool == NULL) return BUFFER_POOL_ERROR_NULL_POOL;
+    if (buffer == NULL) return BUFFER_POOL_ERROR_NULL_BUFFER;
+    if (buffer->type != BUFFER_TYPE_DYNAMIC) return BUFFER_POOL_ERROR_INVALID_TYPE;
+
+    if (!(buffer->flags & BUFFER_FLAG_INLINE) && buffer->ptr != NULL) {
+        unsigned const shift = 63 - __builtin_clzll(buffer->cap);
+
+        if (shift < BUFFER_POOL_CLASS_MIN_SHIFT || shift > BUFFER_POOL_CLASS_MAX_SHIFT) {
+            free(buffer->ptr);
+        } else {
+            buffer_pool_give(pool, shift - BUFFER_POOL_CLASS_MIN_SHIFT, buffer->ptr);
+        }
+    }
+
+    buffer->flags &= ~BUFFER_FLAG_INLINE;
+    buffer->ptr = NULL;
+    buffer->cap = 0;
+    buffer->len = 0;
+
+    return BUFFER_POOL_ERROR_NONE;
+}
+
+/**
+ * @name buffer_pool_trim
+ * @brief Free the blocks that have not been needed since the last trim.
+ * The free list of every class only has to hold the blocks that were taken at the busiest
+ * moment since the last trim, so the blocks that stayed idle all that time are freed.
+ * Blocks in the thread caches are not trimmed.
+ */
+static inline BufferPoolError buffer_pool_trim(BufferPool* const pool) {
+    if (pool == NULL) return BUFFER_POOL_ERROR_NULL_POOL;
+
+    buffer_pool_lock(pool);
+    for (unsigned index = 0; index < BUFFER_POOL_CLASS_COUNT; index += 1) {
+        BufferPoolClass* const class = &pool->classes[index];
+        BufferPoolBlock **link = &class->free;
+
+        // The most recently used blocks are at the front of the list, they are kept.
+        for (size_t kept = class->cached - class->idle; kept > 0; kept -= 1) {
+            link = &(*link)->next;
+        }
+        while (*link != NULL) {
+            BufferPoolBlock* const block = *link;
+            *link = block->next;
+            free(block);
+        }
+
+        class->cached -= class->idle;
+        class->idle = class->cached;
+    }
+    buffer_pool_unlock(pool);
+
+    return BUFFER_POOL_ERROR_NONE;
+}
+
+/**
+ * @name buffer_pool_deinit
+ * @brief Free all the memory in the pool and in the cache of the calling thread.
+ * The buffers that are still in use are not affected, they can be deinitialized as usual.
+ * With BUFFER_POOL_THREAD_CACHE, the pool is left untouched while the cache of any other
+ * thread still holds a slot for it.
+ */
+static inline BufferPoolError buffer_pool_deinit(BufferPool* const pool) {
+    if (pool == NULL) return BUFFER_POOL_ERROR_NULL_POOL;
+
+    buffer_pool_flush_cache(pool);
+
+#ifdef BUFFER_POOL_THREAD_CACHE
+    if (__atomic_load_n(&pool->caches, __ATOMIC_ACQUIRE) != 0) return BUFFER_POOL_ERROR_THREAD_CACHES;
+#endif
+
+    for (unsigned index = 0; index < BUFFER_POOL_CLASS_COUNT; index += 1) {
+        pool->classes[index].idle = pool->classes[index].cached;
+    }
+
+    return buffer_pool_trim(pool);
+}
+
+#endif
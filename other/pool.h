@@ -0,0 +1,394 @@
+#ifndef SAFETYCT_POOL_H
+#define SAFETYCT_POOL_H
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../safetyct.h"
+
+/*
+    A slab allocator of same-size objects, for structs that are allocated and freed
+    at a high rate:
+
+        POOL(Node) nodes;
+        CRASH_SOME(POOL_INIT(&nodes));
+        DEFER(POOL_DEINIT(&nodes));
+
+        Node *node = POOL_ALLOC(&nodes);
+        POOL_FREE(&nodes, node);
+
+    Freed objects are kept in an intrusive free list and reused before new slab memory.
+    In DEBUG mode every object is tracked like a MALLOC, so double frees crash and
+    objects that are never freed show up in the leak report at their POOL_ALLOC call site.
+
+    A pool is not thread-safe by default. Compile with -DPOOL_THREAD_CACHE to make it
+    thread-safe, every thread then allocates and frees through a cache of its own and
+    only locks the pool to move a batch of objects. Every thread other than the one that
+    deinitializes the pool has to give its cache back with `pool_flush_cache` first.
+*/
+
+/**
+ * @name POOL_SLAB_SIZE
+ * @brief The size of the slabs that objects are carved out of.
+ */
+#ifndef POOL_SLAB_SIZE
+    #define POOL_SLAB_SIZE (64 * 1024)
+#endif
+
+#define POOL_SLAB_ALIGN 64                  // Slabs and their headers are cache-line aligned.
+
+/**
+ * @name POOL
+ * @brief The type of a pool of `type` objects.
+ */
+#define POOL(type) struct { Pool base; type* type_tag[0]; }
+
+/**
+ * @name POOL_INIT
+ * @brief Initialize a `POOL(type)`.
+ */
+#define POOL_INIT(pool) \
+    pool_init(&(pool)->base, sizeof(*(pool)->type_tag[0]), _Alignof(typeof(*(pool)->type_tag[0])))
+
+/**
+ * @name POOL_ALLOC
+ * @brief Allocate an object from a `POOL(type)`.
+ * @return A pointer to an uninitialized object, or NULL if a slab could not be allocated.
+ */
+#define POOL_ALLOC(pool)                                                            \
+    ({                                                                              \
+        typeof((pool)->type_tag[0]) const scti_pool_object = pool_alloc(&(pool)->base); \
+        SCTI_ALLOC_SET_INDEX(scti_pool_object, 1, (pool)->base.object_size)         \
+        scti_pool_object;                                                           \
+    })
+
+/**
+ * @name POOL_FREE
+ * @brief Return an object to the `POOL(type)` it was allocated from.
+ */
+#define POOL_FREE(pool, pointer)                    \
+    do {                                            \
+        SCTI_ALLOC_UNSET_INDEX(pointer)             \
+        pool_free(&(pool)->base, (pointer));        \
+    } while (0)
+
+/**
+ * @name POOL_DEINIT
+ * @brief Free all the slabs of a `POOL(type)`.
+ */
+#define POOL_DEINIT(pool) pool_deinit(&(pool)->base)
+
+/**
+ * @name PoolObject
+ * @brief A free object, the link of the free list is stored in the object itself.
+ */
+typedef struct pool_object {
+    struct pool_object *next;
+} PoolObject;
+
+/**
+ * @name PoolSlab
+ * @brief The header at the start of every slab. The slabs of a pool form a list.
+ */
+typedef struct pool_slab {
+    struct pool_slab *next;
+} PoolSlab;
+
+/**
+ * @name Pool
+ * @brief An untyped pool of objects of `object_size` bytes, see `POOL(type)`.
+ */
+typedef struct pool {
+    PoolObject *free;                   // Freed objects, reused first.
+    PoolSlab *slabs;                    // The newest slab.
+    unsigned char *bump, *end;          // The part of the newest slab that has never been allocated.
+    size_t object_size;                 // Size of an object, a multiple of `object_align`.
+    size_t object_align;
+    size_t slab_size;
+    unsigned long long id;              // Identifies the pool in the thread caches.
+    int lock;
+    int caches;                         // Thread caches that hold a slot for the pool.
+} Pool;
+
+/**
+ * @name PoolError
+ * @brief An enum that contains all the pool errors.
+ */
+typedef enum pool_error {
+    POOL_ERROR_NONE,                    // No error.
+    POOL_ERROR_NULL_POOL,               // The `pool` pointer is null.
+    POOL_ERROR_ZERO_SIZE,               // The provided object size is zero.
+    POOL_ERROR_INVALID_ALIGN,           // The alignment is not a power of two, or larger than a slab header.
+    POOL_ERROR_THREAD_CACHES,           // Other threads have not flushed their caches of the pool.
+} PoolError;
+
+__attribute__ ((weak)) unsigned long long pool_next_id;     // The id of the latest initialized pool.
+
+/**
+ * @name pool_init
+ * @brief Initialize an empty pool. The first slab is allocated on the first allocation.
+ */
+__attribute__((warn_unused_result)) static inline PoolError pool_init(
+    Pool* const pool,
+    size_t const object_size,
+    size_t object_align
+) {
+    if (pool == NULL) return POOL_ERROR_NULL_POOL;
+    if (object_size == 0) return POOL_ERROR_ZERO_SIZE;
+    if (object_align == 0 || (object_align & (object_align - 1)) != 0 || object_align > POOL_SLAB_ALIGN) {
+        return POOL_ERROR_INVALID_ALIGN;
+    }
+
+    if (object_align < _Alignof(PoolObject)) object_align = _Alignof(PoolObject);
+
+    pool->free = NULL;
+    pool->slabs = NULL;
+    pool->bump = pool->end = NULL;
+    pool->object_size = (object_size < sizeof(PoolObject) ? sizeof(PoolObject) : object_size);
+    pool->object_size = (pool->object_size + object_align - 1) & ~(object_align - 1);
+    pool->object_align = object_align;
+    pool->slab_size = POOL_SLAB_ALIGN + pool->object_size > POOL_SLAB_SIZE
+        ? POOL_SLAB_ALIGN + pool->object_size
+        : POOL_SLAB_SIZE;
+    pool->slab_size = (pool->slab_size + POOL_SLAB_ALIGN - 1) & ~(size_t)(POOL_SLAB_ALIGN - 1);
+    pool->id = __atomic_add_fetch(&pool_next_id, 1, __ATOMIC_RELAXED);
+    pool->lock = 0;
+    pool->caches = 0;
+
+    return POOL_ERROR_NONE;
+}
+
+/**
+ * @name pool_refill
+ * @brief Take an object from the free list, or from a new part of a slab.
+ * The pool must be locked if it is shared between threads.
+ * @return An object, or NULL if a new slab could not be allocated.
+ */
+static inline void* pool_refill(Pool* const pool) {
+    PoolSlab *slab;
+    void *object;
+
+    if (pool->free != NULL) {
+        object = pool->free;
+        pool->free = pool->free->next;
+        return object;
+    }
+
+    if (pool->bump == pool->end) {
+        slab = aligned_alloc(POOL_SLAB_ALIGN, pool->slab_size);
+        if (slab == NULL) return NULL;
+
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->bump = (unsigned char*) slab + POOL_SLAB_ALIGN;
+        pool->end = pool->bump + (pool->slab_size - POOL_SLAB_ALIGN) / pool->object_size * pool->object_size;
+    }
+
+    object = pool->bump;
+    pool->bump += pool->object_size;
+    return object;
+}
+
+#ifdef POOL_THREAD_CACHE
+
+    #ifndef POOL_THREAD_CACHE_SIZE
+        #define POOL_THREAD_CACHE_SIZE 64   // Objects a thread keeps per pool before returning half of them.
+    #endif
+
+    #define POOL_THREAD_CACHE_SLOTS 16      // Pools a thread can cache objects of at the same time.
+
+    /**
+     * @name PoolCache
+     * @brief The objects a thread has cached for the pool with the id `id`.
+     * The slot is only used for another pool once it is empty. A pool cannot be
+     * deinitialized while a slot refers to it, so `pool` is always alive.
+     */
+    typedef struct pool_cache {
+        unsigned long long id;
+        Pool *pool;
+        PoolObject *head;
+        size_t count;
+    } PoolCache;
+
+    _Thread_local PoolCache pool_thread_caches[POOL_THREAD_CACHE_SLOTS] __attribute__ ((weak));
+
+    static inline void pool_lock(Pool* const pool) {
+        for (int spins = 0; __atomic_exchange_n(&pool->lock, 1, __ATOMIC_ACQUIRE); spins += 1) {
+            if (spins >= 100) {
+                sched_yield();
+            }
+        }
+    }
+
+    static inline void pool_unlock(Pool* const pool) {
+        __atomic_store_n(&pool->lock, 0, __ATOMIC_RELEASE);
+    }
+
+    // The cache slot of the pool, or NULL if the slot is taken by another pool.
+    static inline PoolCache* pool_cache(Pool* const pool) {
+        PoolCache* const cache = &pool_thread_caches[pool->id % POOL_THREAD_CACHE_SLOTS];
+
+        if (cache->id != pool->id) {
+            if (cache->count != 0) return NULL;
+            if (cache->pool != NULL) {
+                __atomic_sub_fetch(&cache->pool->caches, 1, __ATOMIC_RELEASE);
+            }
+            __atomic_add_fetch(&pool->caches, 1, __ATOMIC_ACQUIRE);
+            cache->id = pool->id;
+            cache->pool = pool;
+            cache->head = NULL;
+        }
+
+        return cache;
+    }
+
+    /**
+     * @name pool_alloc
+     * @brief Allocate an object, use `POOL_ALLOC` instead.
+     */
+    static inline void* pool_alloc(Pool* const pool) {
+        PoolCache* const cache = pool_cache(pool);
+        PoolObject *object;
+
+        if (cache != NULL && cache->head != NULL) {
+            object = cache->head;
+            cache->head = object->next;
+            cache->count -= 1;
+            return object;
+        }
+
+        pool_lock(pool);
+        object = pool_refill(pool);
+        if (cache != NULL && object != NULL) {
+            while (cache->count < POOL_THREAD_CACHE_SIZE / 2) {
+                PoolObject* const extra = pool_refill(pool);
+                if (extra == NULL) break;
+                extra->next = cache->head;
+                cache->head = extra;
+                cache->count += 1;
+            }
+        }
+        pool_unlock(pool);
+
+        return object;
+    }
+
+    /**
+     * @name pool_free
+     * @brief Return an object to the pool, use `POOL_FREE` instead.
+     */
+    static inline void pool_free(Pool* const pool, void* const pointer) {
+        PoolCache* const cache = pool_cache(pool);
+        PoolObject* const object = pointer;
+
+        if (object == NULL) return;
+
+        if (cache != NULL && cache->count < POOL_THREAD_CACHE_SIZE) {
+            object->next = cache->head;
+            cache->head = object;
+            cache->count += 1;
+            return;
+        }
+
+        pool_lock(pool);
+        object->next = pool->free;
+        pool->free = object;
+        while (cache != NULL && cache->count > POOL_THREAD_CACHE_SIZE / 2) {
+            PoolObject* const extra = cache->head;
+            cache->head = extra->next;
+            cache->count -= 1;
+            extra->next = pool->free;
+            pool->free = extra;
+        }
+        pool_unlock(pool);
+    }
+
+    /**
+     * @name pool_flush_cache
+     * @brief Return the objects the calling thread has cached to the pool and give up its slot.
+     * Every thread that used the pool has to call this before another thread can deinitialize it.
+     */
+    static inline void pool_flush_cache(Pool* const pool) {
+        PoolCache* const cache = &pool_thread_caches[pool->id % POOL_THREAD_CACHE_SLOTS];
+
+        if (cache->id != pool->id) return;
+
+        pool_lock(pool);
+        while (cache->head != NULL) {
+            PoolObject* const object = cache->head;
+            cache->head = object->next;
+            object->next = pool->free;
+            pool->free = object;
+        }
+        pool_unlock(pool);
+
+        cache->id = 0;
+        cache->pool = NULL;
+        cache->count = 0;
+        __atomic_sub_fetch(&pool->caches, 1, __ATOMIC_RELEASE);
+    }
+
+#else
+
+    /**
+     * @name pool_alloc
+     * @brief Allocate an object, use `POOL_ALLOC` instead.
+     */
+    static inline void* pool_alloc(Pool* const pool) {
+        PoolObject* const object = pool->free;
+
+        if (object != NULL) {
+            pool->free = object->next;
+            return object;
+        }
+
+        return pool_refill(pool);
+    }
+
+    /**
+     * @name pool_free
+     * @brief Return an object to the pool, use `POOL_FREE` instead.
+     */
+    static inline void pool_free(Pool* const pool, void* const pointer) {
+        PoolObject* const object = pointer;
+
+        if (object == NULL) return;
+
+        object->next = pool->free;
+        pool->free = object;
+    }
+
+    #define pool_flush_cache(pool) ((void) (pool))
+
+#endif
+
+/**
+ * @name pool_deinit
+ * @brief Free all the slabs of the pool, including the objects that are still allocated.
+ * With POOL_THREAD_CACHE, the cache of the calling thread is flushed, and the pool is left
+ * untouched while the cache of any other thread still holds a slot for it.
+ */
+static inline PoolError pool_deinit(Pool* const pool) {
+    if (pool == NULL) return POOL_ERROR_NULL_POOL;
+
+    pool_flush_cache(pool);
+
+#ifdef POOL_THREAD_CACHE
+    if (__atomic_load_n(&pool->caches, __ATOMIC_ACQUIRE) != 0) return POOL_ERROR_THREAD_CACHES;
+#endif
+
+    while (pool->slabs != NULL) {
+        PoolSlab* const next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+
+    pool->free = NULL;
+    pool->bump = pool->end = NULL;
+
+    return POOL_ERROR_NONE;
+}
+
+#endif
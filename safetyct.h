@@ -24,12 +24,15 @@
 #define IS_POINTER(x) IS_SAME_TYPE(x, DECAY_POINTER(x))
 #define IS_COMPTIME_KNOWN(x) __builtin_constant_p(x)
 
+// The unselected branch of IS_EQUAL still has to compile, even for an `a` that is not a string.
+#define IS_EQUAL_STRING(a) _Generic((a), char*: (a), char const*: (a), default: (char const*) NULL)
+
 #define IS_EQUAL(a, b)                                  \
     ({                                                  \
         GCC_DIAGNOSTIC_IGNORED("-Wint-conversion")      \
         GCC_DIAGNOSTIC_IGNORED("-Wnonnull")             \
         _Generic((b),                                   \
-            char*: !strcmp((a), (b)),                   \
+            char*: !strcmp(IS_EQUAL_STRING(a), (b)),    \
             default: (a) == (b)                         \
         );                                              \
         GCC_DIAGNOSTIC_WARNING("-Wint-conversion")      \
@@ -48,407 +51,3756 @@
 #define REQUIRE_RESULT __attribute__((warn_unused_result))
 #define INIT INITFUNC void UNIQUE_NAME(init)(void)
 
-#define TO_STRING(x) # x
-#define TO_ARRAY(args...) ((void*[]){args})
+#define TO_STRING(x) # x
+#define TO_ARRAY(args...) ((void*[]){args})
+
+//
+//  GGC DIAGNOSTIC PRAGMAS
+//
+
+#define GCC_DIAGNOSTIC_IGNORED(x) _Pragma(TO_STRING(GCC diagnostic ignored x))
+#define GCC_DIAGNOSTIC_WARNING(x) _Pragma(TO_STRING(GCC diagnostic warning x))
+
+//
+//  VA ARGS
+//
+
+#define ARGS_COUNT(args...)                         \
+    ({                                              \
+        GCC_DIAGNOSTIC_IGNORED("-Wint-conversion")  \
+        (sizeof((void*[]){args}) / sizeof(void*));  \
+        GCC_DIAGNOSTIC_WARNING("-Wint-conversion")  \
+    })
+
+#define ARGS_GET(index, args...)                    \
+    ({                                              \
+        GCC_DIAGNOSTIC_IGNORED("-Wint-conversion")  \
+        (((void*[]){args})[(index)]);               \
+        GCC_DIAGNOSTIC_WARNING("-Wint-conversion")  \
+    })
+
+#define ARGS_HAS_INDEX(index, args...)          \
+    ({                                          \
+        GCC_DIAGNOSTIC_IGNORED("-Wtype-limits") \
+        (ARGS_COUNT(args) - 1 >= (index));      \
+        GCC_DIAGNOSTIC_WARNING("-Wtype-limits") \
+    })
+
+#define ARGS_GET_OR_DEFAULT(index, default, args...)    \
+    ({                                                  \
+        GCC_DIAGNOSTIC_IGNORED("-Warray-bounds")        \
+        typeof(default) value = default;                \
+        if (ARGS_HAS_INDEX(index, args)) {              \
+            GCC_DIAGNOSTIC_IGNORED("-Wint-conversion")  \
+            value = ARGS_GET(index, args);              \
+            GCC_DIAGNOSTIC_WARNING("-Wint-conversion")  \
+        }                                               \
+        value;                                          \
+        GCC_DIAGNOSTIC_WARNING("-Warray-bounds")        \
+    })
+
+//
+//  TRACEBACK
+//
+
+#define SCT_INTERNAL_TRACEBACK_LEADING_TEXT     \
+    "Traceback (most recent call last):\n"
+
+#define SCT_INTERNAL_TRACEBACK_ERRORF_FORMAT    \
+    "    File %s, line %d, in function %s\n"    \
+    "        %s"
+
+// Type tag of a value stored in a traceback frame, resolved at compile time.
+enum sct_internal_traceback_tag {
+    SCT_INTERNAL_TRACEBACK_TAG_CHAR,
+    SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_CHAR,
+    SCT_INTERNAL_TRACEBACK_TAG_INT,
+    SCT_INTERNAL_TRACEBACK_TAG_LONG,
+    SCT_INTERNAL_TRACEBACK_TAG_LONG_LONG,
+    SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED,
+    SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_LONG_LONG,
+    SCT_INTERNAL_TRACEBACK_TAG_STRING,
+    SCT_INTERNAL_TRACEBACK_TAG_POINTER,
+    SCT_INTERNAL_TRACEBACK_TAG_MESSAGE,     // Preformatted message of the *F macros.
+    SCT_INTERNAL_TRACEBACK_TAG_DOUBLE,
+    SCT_INTERNAL_TRACEBACK_TAG_OTHER,       // A struct or union, only its size is printed.
+};
+
+// Small integers are widened to the tag of their promoted type.
+#define SCT_INTERNAL_TRACEBACK_RESOLVE_TAG(evaluation)                                  \
+    _Generic((evaluation),                                                              \
+        _Bool: SCT_INTERNAL_TRACEBACK_TAG_INT,                                          \
+        char: SCT_INTERNAL_TRACEBACK_TAG_CHAR,                                          \
+        signed char: SCT_INTERNAL_TRACEBACK_TAG_INT,                                    \
+        unsigned char: SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_CHAR,                        \
+        short: SCT_INTERNAL_TRACEBACK_TAG_INT,                                          \
+        unsigned short: SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED,                            \
+        int: SCT_INTERNAL_TRACEBACK_TAG_INT,                                            \
+        long int: SCT_INTERNAL_TRACEBACK_TAG_LONG,                                      \
+        long long: SCT_INTERNAL_TRACEBACK_TAG_LONG_LONG,                                \
+        unsigned: SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED,                                  \
+        unsigned long: SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_LONG_LONG,                   \
+        unsigned long long: SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_LONG_LONG,              \
+        float: SCT_INTERNAL_TRACEBACK_TAG_DOUBLE,                                       \
+        double: SCT_INTERNAL_TRACEBACK_TAG_DOUBLE,                                      \
+        long double: SCT_INTERNAL_TRACEBACK_TAG_DOUBLE,                                 \
+        char*: SCT_INTERNAL_TRACEBACK_TAG_STRING,                                       \
+        char const*: SCT_INTERNAL_TRACEBACK_TAG_STRING,                                 \
+        default: __builtin_classify_type(evaluation) == 5                               \
+            ? SCT_INTERNAL_TRACEBACK_TAG_POINTER                                        \
+            : SCT_INTERNAL_TRACEBACK_TAG_OTHER                                          \
+    )
+
+// The evaluation if it is arithmetic, otherwise 0. Lets the value be converted with a cast
+// in code that is only reached for arithmetic tags, but has to compile for every type.
+#define SCT_INTERNAL_TRACEBACK_ARITHMETIC(evaluation)   \
+    _Generic((evaluation),                              \
+        _Bool: (evaluation),                            \
+        char: (evaluation),                             \
+        signed char: (evaluation),                      \
+        unsigned char: (evaluation),                    \
+        short: (evaluation),                            \
+        unsigned short: (evaluation),                   \
+        int: (evaluation),                              \
+        long int: (evaluation),                         \
+        long long: (evaluation),                        \
+        unsigned: (evaluation),                         \
+        unsigned long: (evaluation),                    \
+        unsigned long long: (evaluation),               \
+        float: (evaluation),                            \
+        double: (evaluation),                           \
+        long double: (evaluation),                      \
+        default: 0                                      \
+    )
+
+// The evaluation if it is a string, otherwise NULL.
+#define SCT_INTERNAL_TRACEBACK_STRING(evaluation)       \
+    _Generic((evaluation),                              \
+        char*: (evaluation),                            \
+        char const*: (evaluation),                      \
+        default: (char const*) NULL                     \
+    )
+
+// Maximum length of a formatted traceback message.
+#define SCT_INTERNAL_TRACEBACK_LENGTH_MAX 256
+
+// Maximum length of a string value copied into a traceback frame, longer strings end with "...".
+#define SCT_INTERNAL_TRACEBACK_STRING_MAX 64
+
+// A raw traceback frame. Pushing a frame only copies pointers and the evaluated value,
+// the frame is formatted when the traceback is printed. String values are copied into the
+// frame, because they may live on the stack of a function that has returned by then.
+struct sct_internal_traceback_frame {
+    char const* file;
+    char const* function;
+    char const* description;
+    char const* expression;
+    char const* error;                  // Stringified error, or NULL if the error was not mapped.
+    int line;
+    enum sct_internal_traceback_tag tag;
+    union {
+        char c;
+        unsigned char uc;
+        int i;
+        long int l;
+        long long ll;
+        unsigned u;
+        unsigned long long ull;
+        double d;
+        char const* s;                  // The message of SCT_INTERNAL_TRACEBACK_TAG_MESSAGE.
+        void const* p;
+        size_t size;                    // The size of SCT_INTERNAL_TRACEBACK_TAG_OTHER.
+    } value;
+    char string[SCT_INTERNAL_TRACEBACK_STRING_MAX];
+};
+
+// Copy a string value into a frame, marking it with "..." if it does not fit.
+static inline void sct_internal_traceback_copy_string(
+    struct sct_internal_traceback_frame* const frame,
+    char const* const string
+) {
+    size_t i = 0;
+
+    if (string == NULL) {
+        frame->tag = SCT_INTERNAL_TRACEBACK_TAG_POINTER;
+        return;
+    }
+
+    for (; i + 1 < sizeof(frame->string) && string[i] != '\0'; i += 1) {
+        frame->string[i] = string[i];
+    }
+    frame->string[i] = '\0';
+
+    if (string[i] != '\0') {
+        __builtin_memcpy(frame->string + sizeof(frame->string) - 4, "...", 4);
+    }
+}
+
+// Fill a frame with the current source location and a copy of the evaluated value.
+// The tag is a constant, so only one case of the switch is compiled in.
+#define SCT_INTERNAL_TRACEBACK_FRAME_INIT(frame, label, source, evaluation, error_name)     \
+    do {                                                                                    \
+        typeof((void) 0, (evaluation)) sct_internal_value = (evaluation);                   \
+        (frame).file = __FILE__;                                                            \
+        (frame).function = __PRETTY_FUNCTION__;                                             \
+        (frame).description = (label);                                                     \
+        (frame).expression = (source);                                                      \
+        (frame).error = (error_name);                                                       \
+        (frame).line = __LINE__;                                                            \
+        (frame).tag = SCT_INTERNAL_TRACEBACK_RESOLVE_TAG(sct_internal_value);               \
+        (frame).value.ull = 0;                                                              \
+        switch ((frame).tag) {                                                              \
+            case SCT_INTERNAL_TRACEBACK_TAG_CHAR:                                           \
+                (frame).value.c = (char) SCT_INTERNAL_TRACEBACK_ARITHMETIC(sct_internal_value); \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_CHAR:                                  \
+                (frame).value.uc = (unsigned char) SCT_INTERNAL_TRACEBACK_ARITHMETIC(sct_internal_value); \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_INT:                                            \
+                (frame).value.i = (int) SCT_INTERNAL_TRACEBACK_ARITHMETIC(sct_internal_value); \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_LONG:                                           \
+                (frame).value.l = (long int) SCT_INTERNAL_TRACEBACK_ARITHMETIC(sct_internal_value); \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_LONG_LONG:                                      \
+                (frame).value.ll = (long long) SCT_INTERNAL_TRACEBACK_ARITHMETIC(sct_internal_value); \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED:                                       \
+                (frame).value.u = (unsigned) SCT_INTERNAL_TRACEBACK_ARITHMETIC(sct_internal_value); \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_LONG_LONG:                             \
+                (frame).value.ull = (unsigned long long) SCT_INTERNAL_TRACEBACK_ARITHMETIC(sct_internal_value); \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_DOUBLE:                                         \
+                (frame).value.d = (double) SCT_INTERNAL_TRACEBACK_ARITHMETIC(sct_internal_value); \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_STRING:                                         \
+            case SCT_INTERNAL_TRACEBACK_TAG_MESSAGE:                                        \
+                (frame).value.s = SCT_INTERNAL_TRACEBACK_STRING(sct_internal_value);        \
+                sct_internal_traceback_copy_string(&(frame), (frame).value.s);              \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_POINTER:                                        \
+                __builtin_memcpy(                                                           \
+                    &(frame).value.p,                                                       \
+                    &sct_internal_value,                                                    \
+                    sizeof(sct_internal_value) < sizeof((frame).value.p)                    \
+                        ? sizeof(sct_internal_value)                                        \
+                        : sizeof((frame).value.p)                                           \
+                );                                                                          \
+                break;                                                                      \
+            case SCT_INTERNAL_TRACEBACK_TAG_OTHER:                                          \
+                (frame).value.size = sizeof(sct_internal_value);                            \
+                break;                                                                      \
+        }                                                                                   \
+    } while (0)
+
+static inline void sct_internal_traceback_print_frame(
+    FILE* const stream,
+    struct sct_internal_traceback_frame const* const frame
+) {
+    fprintf(
+        stream,
+        SCT_INTERNAL_TRACEBACK_ERRORF_FORMAT,
+        frame->file, frame->line, frame->function, frame->description
+    );
+
+    if (frame->tag == SCT_INTERNAL_TRACEBACK_TAG_MESSAGE) {
+        if (frame->error != NULL) {
+            fprintf(stream, "-> %s", frame->error);
+        }
+        fprintf(stream, "\n        %s", frame->value.s);
+        return;
+    }
+
+    fprintf(stream, " %s => ", frame->expression);
+
+    switch (frame->tag) {
+        case SCT_INTERNAL_TRACEBACK_TAG_CHAR: fprintf(stream, "%c", frame->value.c); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_CHAR: fprintf(stream, "%d", frame->value.uc); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_INT: fprintf(stream, "%d", frame->value.i); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_LONG: fprintf(stream, "%ld", frame->value.l); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_LONG_LONG: fprintf(stream, "%lld", frame->value.ll); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED: fprintf(stream, "%u", frame->value.u); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_UNSIGNED_LONG_LONG: fprintf(stream, "%llu", frame->value.ull); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_STRING: fprintf(stream, "\"%s\"", frame->string); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_POINTER: fprintf(stream, "%p", frame->value.p); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_MESSAGE: break;
+        case SCT_INTERNAL_TRACEBACK_TAG_DOUBLE: fprintf(stream, "%g", frame->value.d); break;
+        case SCT_INTERNAL_TRACEBACK_TAG_OTHER: fprintf(stream, "<%zu bytes>", frame->value.size); break;
+    }
+
+    if (frame->error != NULL) {
+        fprintf(stream, " -> %s", frame->error);
+    }
+
+    fputc('\n', stream);
+}
+
+//
+//  FLIGHT RECORDER: Keep the latest traceback frames in a memory-mapped file (behind -DSCT_FLIGHT_RECORDER)
+//
+
+// Path of the ring file, can be overridden at runtime with the SCT_FLIGHT_RECORDER environment variable.
+#ifndef SCT_FLIGHT_RECORDER_PATH
+    #define SCT_FLIGHT_RECORDER_PATH "sct_flight_recorder.bin"
+#endif
+
+// Number of records kept in the ring file.
+#ifndef SCT_FLIGHT_RECORDER_CAPACITY
+    #define SCT_FLIGHT_RECORDER_CAPACITY 4096
+#endif
+
+#define SCT_INTERNAL_FLIGHT_MAGIC "SCTFLT1"
+
+enum sct_internal_flight_kind {
+    SCT_INTERNAL_FLIGHT_KIND_PUSH = 1,      // A traceback frame was pushed.
+    SCT_INTERNAL_FLIGHT_KIND_CRASH = 2,     // The frame was pushed right before the program crashed.
+};
+
+// The ring file starts with this header, followed by `capacity` records.
+struct sct_internal_flight_header {
+    char magic[8];
+    unsigned record_size;
+    unsigned capacity;
+    unsigned long long head;                // Total number of records ever written.
+    char reserved[40];
+};
+
+// A fixed-size record. The strings are copied because the pointers of a frame
+// are meaningless outside of the process that recorded it.
+struct sct_internal_flight_record {
+    unsigned long long sequence;            // Zero while the record is being written.
+    long long time;                         // Nanoseconds since the epoch.
+    int pid, tid;
+    int line;
+    unsigned short kind, tag;
+    union {
+        char c;
+        unsigned char uc;
+        int i;
+        long int l;
+        long long ll;
+        unsigned u;
+        unsigned long long ull;
+        double d;
+        void const* p;
+        size_t size;
+    } value;
+    char file[48];
+    char function[40];
+    char description[32];
+    char expression[72];                    // The message of the *F macros, or the expression and
+                                            // a string value in the second half.
+    char error[24];
+};
+
+_Static_assert(sizeof(struct sct_internal_flight_header) == 64, "Unexpected flight header size");
+_Static_assert(sizeof(struct sct_internal_flight_record) == 256, "Unexpected flight record size");
+
+#ifdef SCT_FLIGHT_RECORDER
+
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <time.h>
+    #include <unistd.h>
+
+    __attribute__ ((weak)) struct sct_internal_flight_header* sct_internal_flight_header = NULL;
+    __attribute__ ((weak)) _Thread_local struct sct_internal_flight_record* sct_internal_flight_last = NULL;
+    __attribute__ ((weak)) _Thread_local int sct_internal_flight_tid = 0;
+    __attribute__ ((weak)) int sct_internal_flight_pid = 0;     // getpid and gettid are system calls, so they are cached.
+
+    // A forked child has a pid of its own, and its only thread a tid of its own.
+    static void sct_internal_flight_forked(void) {
+        sct_internal_flight_pid = getpid();
+        sct_internal_flight_tid = 0;
+    }
+
+    static inline void sct_internal_flight_copy(char* const destination, char const* const source, size_t const size) {
+        size_t i = 0;
+        if (source != NULL) {
+            for (; i + 1 < size && source[i] != '\0'; i += 1) {
+                destination[i] = source[i];
+            }
+        }
+        destination[i] = '\0';
+    }
+
+    static inline void sct_internal_flight_record(struct sct_internal_traceback_frame const* const frame) {
+        struct sct_internal_flight_header* const header = sct_internal_flight_header;
+        struct sct_internal_flight_record* record;
+        struct timespec now;
+        unsigned long long index;
+
+        if (header == NULL) {
+            return;
+        }
+        if (sct_internal_flight_tid == 0) {
+            sct_internal_flight_tid = (int) syscall(SYS_gettid);
+        }
+
+        index = __atomic_fetch_add(&header->head, 1, __ATOMIC_RELAXED);
+        record = (struct sct_internal_flight_record*) (header + 1) + index % header->capacity;
+        __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        clock_gettime(CLOCK_REALTIME, &now);
+        record->time = (long long) now.tv_sec * 1000000000 + now.tv_nsec;
+        record->pid = sct_internal_flight_pid;
+        record->tid = sct_internal_flight_tid;
+        record->line = frame->line;
+        record->kind = SCT_INTERNAL_FLIGHT_KIND_PUSH;
+        record->tag = frame->tag;
+        record->value.ull = frame->value.ull;
+        sct_internal_flight_copy(record->file, frame->file, sizeof(record->file));
+        sct_internal_flight_copy(record->function, frame->function, sizeof(record->function));
+        sct_internal_flight_copy(record->description, frame->description, sizeof(record->description));
+        sct_internal_flight_copy(record->error, frame->error, sizeof(record->error));
+
+        if (frame->tag == SCT_INTERNAL_TRACEBACK_TAG_MESSAGE) {
+            sct_internal_flight_copy(record->expression, frame->value.s, sizeof(record->expression));
+        } else {
+            sct_internal_flight_copy(record->expression, frame->expression, sizeof(record->expression) / 2);
+        }
+        if (frame->tag == SCT_INTERNAL_TRACEBACK_TAG_STRING) {
+            sct_internal_flight_copy(
+                record->expression + sizeof(record->expression) / 2,
+                frame->string,
+                sizeof(record->expression) / 2
+            );
+        }
+
+        __atomic_store_n(&record->sequence, index + 1, __ATOMIC_RELEASE);
+        sct_internal_flight_last = record;
+    }
+
+    // Mark the latest record of the current thread as the one that crashed the program.
+    static inline void sct_internal_flight_crash(void) {
+        if (sct_internal_flight_last != NULL) {
+            sct_internal_flight_last->kind = SCT_INTERNAL_FLIGHT_KIND_CRASH;
+        }
+    }
+
+    // Map the ring file. Records of earlier runs are kept, new records continue after them.
+    __attribute__((constructor(101)))
+    static void sct_internal_flight_open(void) {
+        size_t const size = sizeof(struct sct_internal_flight_header)
+            + sizeof(struct sct_internal_flight_record) * SCT_FLIGHT_RECORDER_CAPACITY;
+        char const* path = getenv("SCT_FLIGHT_RECORDER");
+        struct sct_internal_flight_header* header;
+        int fd;
+
+        if (sct_internal_flight_header != NULL) {
+            return;
+        }
+        if (path == NULL || *path == '\0') {
+            path = SCT_FLIGHT_RECORDER_PATH;
+        }
+
+        fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            ERRORF("Failed to open flight recorder file %s\n", path);
+            return;
+        }
+        if (ftruncate(fd, size) == -1) {
+            ERRORF("Failed to resize flight recorder file %s\n", path);
+            close(fd);
+            return;
+        }
+
+        header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (header == MAP_FAILED) {
+            ERRORF("Failed to map flight recorder file %s\n", path);
+            return;
+        }
+
+        if (memcmp(header->magic, SCT_INTERNAL_FLIGHT_MAGIC, sizeof(header->magic)) != 0
+            || header->record_size != sizeof(struct sct_internal_flight_record)
+            || header->capacity != SCT_FLIGHT_RECORDER_CAPACITY
+        ) {
+            memset(header, 0, size);
+            memcpy(header->magic, SCT_INTERNAL_FLIGHT_MAGIC, sizeof(header->magic));
+            header->record_size = sizeof(struct sct_internal_flight_record);
+            header->capacity = SCT_FLIGHT_RECORDER_CAPACITY;
+        }
+
+        sct_internal_flight_pid = getpid();
+        pthread_atfork(NULL, NULL, sct_internal_flight_forked);
+        sct_internal_flight_header = header;
+    }
+
+    #define SCT_INTERNAL_FLIGHT_RECORD(frame) sct_internal_flight_record(&(frame));
+    #define SCT_INTERNAL_FLIGHT_CRASH sct_internal_flight_crash();
+
+#else
+
+    #define SCT_INTERNAL_FLIGHT_RECORD(frame)
+    #define SCT_INTERNAL_FLIGHT_CRASH
+
+#endif
+
+//
+//  SITE TRACEBACK: Keep the propagation chain as site ids in release builds (behind -DSCT_SITE_TRACEBACK)
+//
+
+// A throw or crash site. Every site is placed in the sct_sites section, and the id of a site
+// is its index in the section, so the section doubles as the table that maps ids back to sites.
+struct sct_internal_site {
+    char const* file;
+    char const* function;
+    char const* description;
+    char const* expression;
+    char const* error;
+    long long line;
+};
+
+extern struct sct_internal_site const __start_sct_sites[] __attribute__ ((weak));
+extern struct sct_internal_site const __stop_sct_sites[] __attribute__ ((weak));
+
+// Define the site of the current macro expansion and evaluate to its id.
+#define SCT_INTERNAL_SITE(description, expression, error)                                  \
+    ({                                                                                      \
+        static struct sct_internal_site const sct_internal_site                             \
+            __attribute__ ((section("sct_sites"), used, aligned(8))) = {                    \
+                __FILE__, __PRETTY_FUNCTION__, description, expression, error, __LINE__     \
+            };                                                                              \
+        (unsigned) (&sct_internal_site - __start_sct_sites);                                \
+    })
+
+#if defined(SCT_SITE_TRACEBACK) && !defined(DEBUG)
+
+    #ifndef SCT_SITE_TRACEBACK_COUNT_MAX
+        #define SCT_SITE_TRACEBACK_COUNT_MAX 64
+    #endif
+
+    __attribute__ ((weak)) _Thread_local unsigned sct_internal_site_trace[SCT_SITE_TRACEBACK_COUNT_MAX];
+    __attribute__ ((weak)) _Thread_local unsigned sct_internal_site_trace_count = 0;
+
+    #define SCT_INTERNAL_SITE_RESET sct_internal_site_trace_count = 0;
+
+    #define SCT_INTERNAL_SITE_TRACE(id)                                         \
+        if (sct_internal_site_trace_count < SCT_SITE_TRACEBACK_COUNT_MAX) {     \
+            sct_internal_site_trace[sct_internal_site_trace_count] = (id);      \
+        }                                                                       \
+        sct_internal_site_trace_count += 1;
+
+    // Print the chain that led to the crash. The last site is the crash itself,
+    // which is printed with its value by the caller.
+    static inline void sct_internal_site_print(FILE* const stream) {
+        for (unsigned i = 0; i < sct_internal_site_trace_count && i < SCT_SITE_TRACEBACK_COUNT_MAX; i += 1) {
+            struct sct_internal_site const* const site = &__start_sct_sites[sct_internal_site_trace[i]];
+
+            if (i + 1 == sct_internal_site_trace_count) {
+                break;
+            }
+
+            fprintf(
+                stream,
+                SCT_INTERNAL_TRACEBACK_ERRORF_FORMAT,
+                site->file, (int) site->line, site->function, site->description
+            );
+            if (site->expression != NULL) {
+                fprintf(stream, " %s", site->expression);
+            }
+            if (site->error != NULL) {
+                fprintf(stream, site->expression != NULL ? " -> %s" : "-> %s", site->error);
+            }
+            fputc('\n', stream);
+        }
+    }
+
+    #define SCT_INTERNAL_SITE_PRINT sct_internal_site_print(stderr);
+
+#else
+
+    #define SCT_INTERNAL_SITE_RESET
+    #define SCT_INTERNAL_SITE_TRACE(id)
+    #define SCT_INTERNAL_SITE_PRINT
+
+#endif
+
+//
+//  SITE COUNTERS: Count how often each site fires, readable with tools/sctstat.c (behind -DSCT_SITE_COUNTERS)
+//
+
+#define SCT_INTERNAL_COUNTERS_MAGIC "SCTCNT1"
+
+// The shared memory segment /sct.<pid> starts with this header, followed by one counter per site.
+struct sct_internal_counters_header {
+    char magic[8];
+    int pid;
+    unsigned count;
+    char reserved[48];
+};
+
+// The strings are copied from the site table, so that other processes can read them.
+struct sct_internal_counter {
+    unsigned long long count;
+    long long line;
+    char file[64];
+    char function[64];
+    char description[32];
+    char expression[56];
+    char error[24];
+};
+
+_Static_assert(sizeof(struct sct_internal_counters_header) == 64, "Unexpected counters header size");
+_Static_assert(sizeof(struct sct_internal_counter) == 256, "Unexpected counter size");
+
+#ifdef SCT_SITE_COUNTERS
+
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+
+    __attribute__ ((weak)) struct sct_internal_counter* sct_internal_counters = NULL;
+
+    #define SCT_INTERNAL_SITE_COUNT(id)                                                         \
+        if (sct_internal_counters != NULL) {                                                    \
+            __atomic_fetch_add(&sct_internal_counters[(id)].count, 1, __ATOMIC_RELAXED);        \
+        }
+
+    static inline void sct_internal_counters_copy(char* const destination, char const* const source, size_t const size) {
+        if (source != NULL) {
+            strncpy(destination, source, size - 1);
+        }
+    }
+
+    static inline void sct_internal_counters_name(char* const name, size_t const size) {
+        snprintf(name, size, "/sct.%d", (int) getpid());
+    }
+
+    // Create the shared memory segment and fill in the sites. The counters start at zero.
+    __attribute__((constructor(101)))
+    static void sct_internal_counters_open(void) {
+        unsigned const count = __stop_sct_sites - __start_sct_sites;
+        size_t const size = sizeof(struct sct_internal_counters_header) + sizeof(struct sct_internal_counter) * count;
+        struct sct_internal_counters_header* header;
+        struct sct_internal_counter* counters;
+        char name[32];
+        int fd;
+
+        if (sct_internal_counters != NULL || count == 0) {
+            return;
+        }
+
+        sct_internal_counters_name(name, sizeof(name));
+        fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            ERRORF("Failed to open shared memory %s\n", name);
+            return;
+        }
+        if (ftruncate(fd, size) == -1) {
+            ERRORF("Failed to resize shared memory %s\n", name);
+            close(fd);
+            shm_unlink(name);
+            return;
+        }
+
+        header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (header == MAP_FAILED) {
+            ERRORF("Failed to map shared memory %s\n", name);
+            shm_unlink(name);
+            return;
+        }
+
+        counters = (struct sct_internal_counter*) (header + 1);
+        for (unsigned i = 0; i < count; i += 1) {
+            struct sct_internal_site const* const site = &__start_sct_sites[i];
+            counters[i].line = site->line;
+            sct_internal_counters_copy(counters[i].file, site->file, sizeof(counters[i].file));
+            sct_internal_counters_copy(counters[i].function, site->function, sizeof(counters[i].function));
+            sct_internal_counters_copy(counters[i].description, site->description, sizeof(counters[i].description));
+            sct_internal_counters_copy(counters[i].expression, site->expression, sizeof(counters[i].expression));
+            sct_internal_counters_copy(counters[i].error, site->error, sizeof(counters[i].error));
+        }
+
+        header->pid = getpid();
+        header->count = count;
+        __atomic_store_n(&sct_internal_counters, counters, __ATOMIC_RELEASE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        memcpy(header->magic, SCT_INTERNAL_COUNTERS_MAGIC, sizeof(header->magic));
+    }
+
+    __attribute__((destructor))
+    static void sct_internal_counters_close(void) {
+        char name[32];
+
+        if (sct_internal_counters == NULL) {
+            return;
+        }
+
+        sct_internal_counters_name(name, sizeof(name));
+        shm_unlink(name);
+        sct_internal_counters = NULL;
+    }
+
+    // Count a site that does not take part in the traceback.
+    #define SCT_INTERNAL_SITE_COUNT_ONLY(description, expression)                                  \
+        do {                                                                                        \
+            unsigned const sct_internal_site_id = SCT_INTERNAL_SITE(description, expression, NULL); \
+            SCT_INTERNAL_SITE_COUNT(sct_internal_site_id)                                           \
+        } while (0);
+
+#else
+
+    #define SCT_INTERNAL_SITE_COUNT(id)
+    #define SCT_INTERNAL_SITE_COUNT_ONLY(description, expression)
+
+#endif
+
+#if (defined(SCT_SITE_TRACEBACK) && !defined(DEBUG)) || defined(SCT_SITE_COUNTERS)
+
+    #define SCT_INTERNAL_SITE_PUSH(description, expression, error)                                 \
+        do {                                                                                        \
+            unsigned const sct_internal_site_id = SCT_INTERNAL_SITE(description, expression, error); \
+            SCT_INTERNAL_SITE_TRACE(sct_internal_site_id)                                           \
+            SCT_INTERNAL_SITE_COUNT(sct_internal_site_id)                                           \
+        } while (0);
+
+#else
+
+    #define SCT_INTERNAL_SITE_PUSH(description, expression, error)
+
+#endif
+
+//
+//  DEBUG MODE: Expand debugging capabilities with longer error messages
+//
+
+#ifdef DEBUG
+
+    //
+    //  TRACEBACK
+    //
+
+    #define TRACE(expression)                                               \
+        ({                                                                  \
+            typeof(expression) evaluation = (expression);                   \
+            SCT_INTERNAL_TRACEBACK_PUSH("TRACE", expression, evaluation);   \
+            evaluation;                                                     \
+        })
+
+    #define SCT_INTERNAL_TRACEBACK_COUNT_MAX 256
+    #define SCT_INTERNAL_TRACEBACK_MESSAGES_COUNT_MAX 16
+
+    // The traceback is per thread, and the weak definitions are merged by the linker
+    // so that every compilation unit shares a single traceback.
+    #define SCT_INTERNAL_TRACEBACK_STORAGE _Thread_local __attribute__ ((weak))
+
+    SCT_INTERNAL_TRACEBACK_STORAGE int sct_internal_traceback_count = 0;
+    SCT_INTERNAL_TRACEBACK_STORAGE struct sct_internal_traceback_frame sct_internal_traceback[SCT_INTERNAL_TRACEBACK_COUNT_MAX];
+
+    // Only the *F macros format eagerly, their messages are kept here until the traceback is reset.
+    SCT_INTERNAL_TRACEBACK_STORAGE int sct_internal_traceback_messages_count = 0;
+    SCT_INTERNAL_TRACEBACK_STORAGE char sct_internal_traceback_messages[SCT_INTERNAL_TRACEBACK_MESSAGES_COUNT_MAX][SCT_INTERNAL_TRACEBACK_LENGTH_MAX];
+
+    #define SCT_INTERNAL_TRACEBACK_RESET                \
+        sct_internal_traceback_count = 0;               \
+        sct_internal_traceback_messages_count = 0;
+
+    // TODO: Else crash? At least warn that the traceback count has been reached
+    #define SCT_INTERNAL_TRACEBACK_STORE(frame)                                         \
+        if (sct_internal_traceback_count < SCT_INTERNAL_TRACEBACK_COUNT_MAX) {          \
+            sct_internal_traceback[sct_internal_traceback_count++] = (frame);           \
+        }
+
+    // The message has to outlive the macro, if all slots are taken NULL is returned.
+    #define SCT_INTERNAL_TRACEBACK_MESSAGE_ALLOCATE(buffer)                                         \
+        ((void) (buffer),                                                                           \
+        sct_internal_traceback_messages_count < SCT_INTERNAL_TRACEBACK_MESSAGES_COUNT_MAX           \
+            ? sct_internal_traceback_messages[sct_internal_traceback_messages_count++]              \
+            : NULL)
+
+    #define SCT_INTERNAL_TRACEBACK_PRINT(description, expression, evaluation)           \
+        do {                                                                            \
+            fprintf(stderr, SCT_INTERNAL_TRACEBACK_LEADING_TEXT);                       \
+            for (int sct_internal_index = 0;                                            \
+                sct_internal_index < sct_internal_traceback_count;                      \
+                sct_internal_index += 1                                                 \
+            ) {                                                                         \
+                sct_internal_traceback_print_frame(                                     \
+                    stderr, &sct_internal_traceback[sct_internal_index]                 \
+                );                                                                      \
+            }                                                                           \
+        } while (0);
+
+    #define SCT_INTERNAL_TRACEBACK_PRINTF(description, format, args...) SCT_INTERNAL_TRACEBACK_PRINT(0, 0, 0)
+
+    //
+    //  INTERNAL MEMORY ALLOCATION
+    //
+
+    #include <sched.h>
+
+    #define SCTI_ALLOC_CAPACITY_MIN 64       // Must be a power of two
+    #define SCTI_ALLOC_SHARD_BITS 6
+    #define SCTI_ALLOC_SHARD_COUNT (1 << SCTI_ALLOC_SHARD_BITS)
+    #define SCTI_ALLOC_HISTOGRAM_SIZE 48    // Power of two buckets of allocation sizes
+
+    // Every Nth allocation of a site is added to the size histogram of the site.
+    #ifndef SCT_ALLOC_PROFILE_SAMPLE_RATE
+        #define SCT_ALLOC_PROFILE_SAMPLE_RATE 16
+    #endif
+
+    // The statistics of a MALLOC, CALLOC or REALLOC call site. Every site is placed in
+    // the scti_alloc_sites section, so that the profile can list all of them.
+    struct scti_alloc_site {
+        char const* file;
+        char const* function;
+        long long line;
+        unsigned long long live_bytes;
+        unsigned long long peak_bytes;
+        unsigned long long total_bytes;
+        unsigned long long count;
+        unsigned long long histogram[SCTI_ALLOC_HISTOGRAM_SIZE];
+    };
+
+    extern struct scti_alloc_site __start_scti_alloc_sites[] __attribute__ ((weak));
+    extern struct scti_alloc_site __stop_scti_alloc_sites[] __attribute__ ((weak));
+
+    // Define the call site of the current macro expansion and evaluate to a pointer to it.
+    #define SCTI_ALLOC_SITE                                                                 \
+        ({                                                                                  \
+            static struct scti_alloc_site scti_alloc_site                                   \
+                __attribute__ ((section("scti_alloc_sites"), used, aligned(8))) = {         \
+                    __FILE__, __PRETTY_FUNCTION__, __LINE__, 0, 0, 0, 0, {0}                \
+                };                                                                          \
+            &scti_alloc_site;                                                               \
+        })
+
+    // A tracked allocation in the open-addressing table, the slot is empty if `pointer` is NULL.
+    struct scti_alloc_entry {
+        void const* pointer;
+        size_t count;                                                           // element count
+        size_t size;                                                            // element size
+        struct scti_alloc_site* site;
+    };
+
+    // The allocations are split into lock-striped shards by pointer hash, so a pointer always
+    // maps to the same shard no matter which thread allocates or frees it.
+    struct scti_alloc_shard {
+        int lock;
+        size_t capacity;
+        size_t count;
+        struct scti_alloc_entry* entries;
+    } __attribute__ ((aligned(64)));
+
+    // Weak, so that all compilation units share the same tracker.
+    __attribute__ ((weak)) struct scti_alloc_shard scti_alloc_shards[SCTI_ALLOC_SHARD_COUNT];
+    __attribute__ ((weak)) int scti_alloc_destruct = 1;
+    __attribute__ ((weak)) int scti_alloc_checked = 0;
+    __attribute__ ((weak)) int scti_alloc_profiled = 0;
+
+    static inline void scti_alloc_site_add(struct scti_alloc_site* const site, size_t const bytes) {
+        unsigned long long const count = __atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED);
+        unsigned long long const live = __atomic_add_fetch(&site->live_bytes, bytes, __ATOMIC_RELAXED);
+        unsigned long long peak = __atomic_load_n(&site->peak_bytes, __ATOMIC_RELAXED);
+
+        __atomic_fetch_add(&site->total_bytes, bytes, __ATOMIC_RELAXED);
+
+        while (live > peak
+            && !__atomic_compare_exchange_n(&site->peak_bytes, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+        ) {
+        }
+
+        if (count % SCT_ALLOC_PROFILE_SAMPLE_RATE == 0) {
+            size_t const bucket = bytes == 0 ? 0 : (size_t) (63 - __builtin_clzll(bytes));
+            __atomic_fetch_add(
+                &site->histogram[bucket < SCTI_ALLOC_HISTOGRAM_SIZE ? bucket : SCTI_ALLOC_HISTOGRAM_SIZE - 1],
+                1,
+                __ATOMIC_RELAXED
+            );
+        }
+    }
+
+    static inline void scti_alloc_site_remove(struct scti_alloc_site* const site, size_t const bytes) {
+        __atomic_fetch_sub(&site->live_bytes, bytes, __ATOMIC_RELAXED);
+    }
+
+    // Mix all bits of the pointer, the low bits are mostly zero because of alignment.
+    __attribute__ ((access(none, 1))) static inline size_t scti_alloc_hash(void const* const pointer) {
+        unsigned long long x = (unsigned long long) (size_t) pointer;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return (size_t) x;
+    }
+
+    // The top bits of the hash select the shard, the bottom bits the slot in the shard.
+    static inline struct scti_alloc_shard* scti_alloc_shard(size_t const hash) {
+        return &scti_alloc_shards[hash >> (sizeof(size_t) * 8 - SCTI_ALLOC_SHARD_BITS)];
+    }
+
+    // Spin for a while, then give the time slice away in case the holder was preempted.
+    static inline void scti_alloc_lock(struct scti_alloc_shard* const shard) {
+        while (__atomic_exchange_n(&shard->lock, 1, __ATOMIC_ACQUIRE)) {
+            for (int spins = 0; __atomic_load_n(&shard->lock, __ATOMIC_RELAXED); spins += 1) {
+                if (spins >= 100) {
+                    sched_yield();
+                }
+            }
+        }
+    }
+
+    static inline void scti_alloc_unlock(struct scti_alloc_shard* const shard) {
+        __atomic_store_n(&shard->lock, 0, __ATOMIC_RELEASE);
+    }
+
+    // The shard must be locked.
+    __attribute__ ((access(none, 2))) static inline struct scti_alloc_entry* scti_alloc_find(
+        struct scti_alloc_shard const* const shard,
+        void const* const pointer,
+        size_t const hash
+    ) {
+        size_t const mask = shard->capacity - 1;
+
+        if (shard->capacity == 0) {
+            return NULL;
+        }
+
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            if (shard->entries[i].pointer == pointer) {
+                return &shard->entries[i];
+            }
+            if (shard->entries[i].pointer == NULL) {
+                return NULL;
+            }
+        }
+    }
+
+    // The shard must be locked.
+    static inline void scti_alloc_resize(struct scti_alloc_shard* const shard, size_t const capacity) {
+        struct scti_alloc_entry* const entries = calloc(capacity, sizeof(*entries));
+        size_t const mask = capacity - 1;
+
+        if (entries == NULL) {
+            scti_alloc_destruct = 0;
+            PANICF("Failed to grow the allocation table to %zu entries!\n", capacity);
+        }
+
+        for (size_t i = 0; i < shard->capacity; i += 1) {
+            if (shard->entries[i].pointer != NULL) {
+                size_t j = scti_alloc_hash(shard->entries[i].pointer) & mask;
+                while (entries[j].pointer != NULL) {
+                    j = (j + 1) & mask;
+                }
+                entries[j] = shard->entries[i];
+            }
+        }
+
+        free(shard->entries);
+        shard->entries = entries;
+        shard->capacity = capacity;
+    }
+
+    // Returns 0 if the pointer is already tracked. The shard is kept at most half full.
+    // The pointed-to memory is never read, which keeps -Wmaybe-uninitialized quiet for fresh allocations.
+    __attribute__ ((access(none, 1))) static inline int scti_alloc_insert(
+        void const* const pointer,
+        size_t const count,
+        size_t const size,
+        struct scti_alloc_site* const site
+    ) {
+        size_t const hash = scti_alloc_hash(pointer);
+        struct scti_alloc_shard* const shard = scti_alloc_shard(hash);
+        size_t mask, i;
+
+        scti_alloc_lock(shard);
+
+        if ((shard->count + 1) * 2 > shard->capacity) {
+            scti_alloc_resize(shard, shard->capacity == 0 ? SCTI_ALLOC_CAPACITY_MIN : shard->capacity * 2);
+        }
+
+        mask = shard->capacity - 1;
+        for (i = hash & mask; shard->entries[i].pointer != NULL; i = (i + 1) & mask) {
+            if (shard->entries[i].pointer == pointer) {
+                scti_alloc_unlock(shard);
+                return 0;
+            }
+        }
+
+        shard->entries[i].pointer = pointer;
+        shard->entries[i].count = count;
+        shard->entries[i].size = size;
+        shard->entries[i].site = site;
+        shard->count += 1;
+
+        scti_alloc_unlock(shard);
+
+        scti_alloc_site_add(site, count * size);
+        return 1;
+    }
+
+    // Returns 0 if the pointer is not tracked. The following entries of the probe sequence
+    // are shifted back, so no tombstones are needed.
+    __attribute__ ((access(none, 1))) static inline int scti_alloc_erase(void const* const pointer) {
+        size_t const hash = scti_alloc_hash(pointer);
+        struct scti_alloc_shard* const shard = scti_alloc_shard(hash);
+        struct scti_alloc_entry* entry;
+        size_t mask, i, j;
+
+        scti_alloc_lock(shard);
+
+        entry = scti_alloc_find(shard, pointer, hash);
+        if (entry == NULL) {
+            scti_alloc_unlock(shard);
+            return 0;
+        }
+
+        scti_alloc_site_remove(entry->site, entry->count * entry->size);
+
+        mask = shard->capacity - 1;
+        i = entry - shard->entries;
+        for (j = (i + 1) & mask; shard->entries[j].pointer != NULL; j = (j + 1) & mask) {
+            size_t const home = scti_alloc_hash(shard->entries[j].pointer) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                shard->entries[i] = shard->entries[j];
+                i = j;
+            }
+        }
+
+        shard->entries[i].pointer = NULL;
+        shard->count -= 1;
+
+        scti_alloc_unlock(shard);
+        return 1;
+    }
+
+    // Returns 0 if the pointer is not tracked, otherwise the element count is written to `count`.
+    __attribute__ ((access(none, 1))) static inline int scti_alloc_lookup(void const* const pointer, size_t* const count) {
+        size_t const hash = scti_alloc_hash(pointer);
+        struct scti_alloc_shard* const shard = scti_alloc_shard(hash);
+        struct scti_alloc_entry const* entry;
+
+        scti_alloc_lock(shard);
+        entry = scti_alloc_find(shard, pointer, hash);
+        if (entry != NULL) {
+            *count = entry->count;
+        }
+        scti_alloc_unlock(shard);
+
+        return entry != NULL;
+    }
+
+    // Failed allocations are not tracked.
+    #define SCTI_ALLOC_SET_INDEX(pointer, count, size)                                      \
+        do {                                                                                \
+            if ((pointer) != NULL                                                           \
+                && !scti_alloc_insert(pointer, count, size, SCTI_ALLOC_SITE)                \
+            ) {                                                                             \
+                scti_alloc_destruct = 0;                                                    \
+                SCT_INTERNAL_CRASHF(                                                        \
+                    "ALLOC_SET_INDEX",                                                      \
+                    "Pointer is already tracked!\n"                                         \
+                );                                                                          \
+            }                                                                               \
+        } while (0);
+
+    // Freeing a null pointer is a no-op, like `free`.
+    #define SCTI_ALLOC_UNSET_INDEX(pointer)                                 \
+        do {                                                                \
+            if ((pointer) != NULL && !scti_alloc_erase(pointer)) {          \
+                scti_alloc_destruct = 0;                                    \
+                SCT_INTERNAL_CRASHF(                                        \
+                    "ALLOC_UNSET_INDEX",                                    \
+                    "Pointer not found!\n"                                  \
+                );                                                          \
+            }                                                               \
+        } while (0);
+
+    #define SCTI_ALLOC_BOUNDS_CHECK(pointer, index)                                         \
+        do {                                                                                \
+            size_t scti_count = 0;                                                          \
+            if (!scti_alloc_lookup(pointer, &scti_count)) {                                 \
+                break;                                                                      \
+            }                                                                               \
+            if ((size_t) (index) >= scti_count) {                                           \
+                scti_alloc_destruct = 0;                                                    \
+                SCT_INTERNAL_CRASHF(                                                        \
+                    "ALLOC_BOUNDS_CHECK",                                                   \
+                    "Index out of bounds: %zu > %zu\n",                                     \
+                    (size_t) (index), scti_count - 1                                        \
+                );                                                                          \
+            }                                                                               \
+        } while (0);
+
+    // Every compilation unit registers this destructor, the first one to run reports the leaks of all shards.
+    __attribute__((destructor))
+    static inline void scti_check_for_leaks(void) {
+        struct scti_alloc_entry const* entry;
+        int header_printed = 0;
+
+        if (!scti_alloc_destruct || __atomic_exchange_n(&scti_alloc_checked, 1, __ATOMIC_ACQ_REL)) {
+            return;
+        }
+
+        for (size_t shard = 0; shard < SCTI_ALLOC_SHARD_COUNT; shard += 1) {
+            scti_alloc_lock(&scti_alloc_shards[shard]);
+
+            for (size_t i = 0; i < scti_alloc_shards[shard].capacity; i += 1) {
+                entry = &scti_alloc_shards[shard].entries[i];
+
+                if (entry->pointer != NULL) {
+                    if (!header_printed) {
+                        fprintf(stderr, "\e[31m\nMemory leaks:\n");
+                        header_printed = 1;
+                    }
+                    fprintf(
+                        stderr,
+                        "  %10zu bytes allocated in file %s, line %lld, in function %s\n",
+                        entry->count * entry->size, entry->site->file, entry->site->line, entry->site->function
+                    );
+                }
+            }
+
+            scti_alloc_unlock(&scti_alloc_shards[shard]);
+        }
+    }
+
+    // Forget every tracked allocation. A forked test calls this, so it only reports the
+    // leaks of its own allocations and not the memory of the runner and its fixtures.
+    static inline void scti_alloc_forget(void) {
+        for (size_t shard = 0; shard < SCTI_ALLOC_SHARD_COUNT; shard += 1) {
+            scti_alloc_lock(&scti_alloc_shards[shard]);
+            if (scti_alloc_shards[shard].entries != NULL) {
+                memset(
+                    scti_alloc_shards[shard].entries, 0,
+                    scti_alloc_shards[shard].capacity * sizeof(*scti_alloc_shards[shard].entries)
+                );
+            }
+            scti_alloc_shards[shard].count = 0;
+            scti_alloc_unlock(&scti_alloc_shards[shard]);
+        }
+    }
+
+    // Print the statistics and the sampled size histogram of every allocation site.
+    static inline void scti_alloc_profile_print(FILE* const stream) {
+        fprintf(stream, "%12s %12s %12s %10s  %s\n", "live bytes", "peak bytes", "total bytes", "count", "site");
+
+        for (struct scti_alloc_site const* site = __start_scti_alloc_sites; site < __stop_scti_alloc_sites; site += 1) {
+            if (site->count == 0) {
+                continue;
+            }
+
+            fprintf(
+                stream,
+                "%12llu %12llu %12llu %10llu  file %s, line %lld, in function %s\n",
+                site->live_bytes, site->peak_bytes, site->total_bytes, site->count,
+                site->file, site->line, site->function
+            );
+
+            // The first bucket also counts zero-byte allocations.
+            fprintf(stream, "%49s", "sizes:");
+            for (size_t i = 0; i < SCTI_ALLOC_HISTOGRAM_SIZE; i += 1) {
+                if (site->histogram[i] != 0) {
+                    fprintf(stream, " [%llu, %llu): %llu", i == 0 ? 0 : 1ULL << i, 2ULL << i, site->histogram[i]);
+                }
+            }
+            fputc('\n', stream);
+        }
+    }
+
+    // Print the total bytes of every allocation site in the folded stack format,
+    // which is read by flame graph tools and speedscope.
+    static inline void scti_alloc_profile_print_folded(FILE* const stream) {
+        for (struct scti_alloc_site const* site = __start_scti_alloc_sites; site < __stop_scti_alloc_sites; site += 1) {
+            if (site->total_bytes != 0) {
+                fprintf(stream, "%s;%s:%lld %llu\n", site->function, site->file, site->line, site->total_bytes);
+            }
+        }
+    }
+
+    // Write the folded profile to the file named by the SCT_ALLOC_PROFILE environment variable.
+    __attribute__((destructor))
+    static void scti_alloc_profile_at_exit(void) {
+        char const* const path = getenv("SCT_ALLOC_PROFILE");
+        FILE* stream;
+
+        if (path == NULL || *path == '\0' || __atomic_exchange_n(&scti_alloc_profiled, 1, __ATOMIC_ACQ_REL)) {
+            return;
+        }
+
+        stream = fopen(path, "w");
+        if (stream == NULL) {
+            ERRORF("Failed to open allocation profile %s\n", path);
+            return;
+        }
+
+        scti_alloc_profile_print_folded(stream);
+        fclose(stream);
+    }
+
+    #define ALLOC_PROFILE_PRINT(stream) scti_alloc_profile_print(stream)
+    #define ALLOC_PROFILE_PRINT_FOLDED(stream) scti_alloc_profile_print_folded(stream)
+
+#else
+
+    //
+    //  TRACEBACK
+    //
+
+    #define TRACE(expression) expression
+    #define SCT_INTERNAL_TRACEBACK_RESET SCT_INTERNAL_SITE_RESET
+    #define SCT_INTERNAL_TRACEBACK_STORE(frame)
+
+    // The flight recorder copies the message right away, so a buffer on the stack is enough.
+    #define SCT_INTERNAL_TRACEBACK_MESSAGE_ALLOCATE(buffer) (buffer)
+
+    #define SCT_INTERNAL_TRACEBACK_PRINT(description, expression, evaluation)   \
+        do {                                                                    \
+            struct sct_internal_traceback_frame sct_internal_frame;             \
+            SCT_INTERNAL_TRACEBACK_FRAME_INIT(                                  \
+                sct_internal_frame, description, TO_STRING(expression),         \
+                evaluation, NULL                                                \
+            );                                                                  \
+            fprintf(stderr, SCT_INTERNAL_TRACEBACK_LEADING_TEXT);               \
+            SCT_INTERNAL_SITE_PRINT                                             \
+            sct_internal_traceback_print_frame(stderr, &sct_internal_frame);    \
+        } while (0);
+
+    #define SCT_INTERNAL_TRACEBACK_PRINTF(description, format, args...) \
+        do {                                                            \
+            fprintf(stderr, SCT_INTERNAL_TRACEBACK_LEADING_TEXT);       \
+            SCT_INTERNAL_SITE_PRINT                                     \
+            fprintf(                                                    \
+                stderr,                                                 \
+                SCT_INTERNAL_TRACEBACK_ERRORF_FORMAT "\n"               \
+                "        "                                              \
+                format,                                                 \
+                __FILE__, __LINE__, __PRETTY_FUNCTION__, description,   \
+                ## args                                                 \
+            );                                                          \
+        } while (0);
+
+    //
+    //  INTERNAL MEMORY ALLOCATION
+    //
+
+    #define SCTI_ALLOC_SET_INDEX(pointer, count, size)
+    #define SCTI_ALLOC_UNSET_INDEX(pointer)
+    #define SCTI_ALLOC_BOUNDS_CHECK(pointer, index)
+
+    #define ALLOC_PROFILE_PRINT(stream)
+    #define ALLOC_PROFILE_PRINT_FOLDED(stream)
+
+#endif
+
+//
+//  TRACEBACK PUSH: Frames are collected in DEBUG mode and by the flight recorder, site ids in release mode
+//
+
+#if defined(DEBUG) || defined(SCT_FLIGHT_RECORDER)
+
+    #define SCT_INTERNAL_TRACEBACK_PUSH_FRAME(description, expression, evaluation, error)  \
+        do {                                                                            \
+            struct sct_internal_traceback_frame sct_internal_frame;                     \
+            SCT_INTERNAL_TRACEBACK_FRAME_INIT(                                          \
+                sct_internal_frame, description, expression, evaluation, error          \
+            );                                                                          \
+            SCT_INTERNAL_TRACEBACK_STORE(sct_internal_frame)                            \
+            SCT_INTERNAL_FLIGHT_RECORD(sct_internal_frame)                              \
+            SCT_INTERNAL_SITE_PUSH(description, expression, error)                      \
+        } while (0);
+
+    // If no message buffer is available, the unformatted format string is kept instead.
+    #define SCT_INTERNAL_TRACEBACK_PUSH_MESSAGE(description, error, format, args...)               \
+        do {                                                                                        \
+            char sct_internal_message_buffer[SCT_INTERNAL_TRACEBACK_LENGTH_MAX];                    \
+            char* sct_internal_message =                                                            \
+                SCT_INTERNAL_TRACEBACK_MESSAGE_ALLOCATE(sct_internal_message_buffer);               \
+            struct sct_internal_traceback_frame sct_internal_frame;                                 \
+            if (sct_internal_message != NULL) {                                                     \
+                snprintf(sct_internal_message, SCT_INTERNAL_TRACEBACK_LENGTH_MAX, format, ## args); \
+            }                                                                                       \
+            SCT_INTERNAL_TRACEBACK_FRAME_INIT(                                                      \
+                sct_internal_frame, description, NULL,                                              \
+                sct_internal_message != NULL ? sct_internal_message : format, error                 \
+            );                                                                                      \
+            sct_internal_frame.tag = SCT_INTERNAL_TRACEBACK_TAG_MESSAGE;                            \
+            SCT_INTERNAL_TRACEBACK_STORE(sct_internal_frame)                                        \
+            SCT_INTERNAL_FLIGHT_RECORD(sct_internal_frame)                                          \
+            SCT_INTERNAL_SITE_PUSH(description, NULL, error)                                        \
+        } while (0);
+
+    #define SCT_INTERNAL_TRACEBACK_PUSH(description, expression, evaluation)                        \
+        SCT_INTERNAL_TRACEBACK_PUSH_FRAME(description, TO_STRING(expression), evaluation, NULL)
+
+    #define SCT_INTERNAL_TRACEBACK_PUSH_WITH_ERROR(description, expression, evaluation, error)              \
+        SCT_INTERNAL_TRACEBACK_PUSH_FRAME(description, TO_STRING(expression), evaluation, TO_STRING(error))
+
+    #define SCT_INTERNAL_TRACEBACK_PUSHF(description, format, args...)              \
+        SCT_INTERNAL_TRACEBACK_PUSH_MESSAGE(description, NULL, format, ## args)
+
+    #define SCT_INTERNAL_TRACEBACK_PUSHF_WITH_ERROR(description, error, format, args...)    \
+        SCT_INTERNAL_TRACEBACK_PUSH_MESSAGE(description, # error, format, ## args)
+
+#else
+
+    #define SCT_INTERNAL_TRACEBACK_PUSH(description, expression, evaluation)    \
+        SCT_INTERNAL_SITE_PUSH(description, TO_STRING(expression), NULL)
+
+    #define SCT_INTERNAL_TRACEBACK_PUSH_WITH_ERROR(description, expression, evaluation, error)  \
+        SCT_INTERNAL_SITE_PUSH(description, TO_STRING(expression), TO_STRING(error))
+
+    #define SCT_INTERNAL_TRACEBACK_PUSHF(description, format, args...)  \
+        SCT_INTERNAL_SITE_PUSH(description, NULL, NULL)
+
+    #define SCT_INTERNAL_TRACEBACK_PUSHF_WITH_ERROR(description, error, format, args...)    \
+        SCT_INTERNAL_SITE_PUSH(description, NULL, # error)
+
+#endif
+
+//
+//  TESTING MODE: Run tests defined in the source files
+//
+
+#ifdef TESTS
+
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <fnmatch.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <sys/resource.h>
+    #include <sys/wait.h>
+    #include <time.h>
+    #include <unistd.h>
+
+    #define SCT_INTERNAL_TEST_SLOWEST_COUNT 10
+    #define SCT_INTERNAL_TEST_REPORTERS_MAX 3
+    #define SCT_INTERNAL_TEST_REAP_MS 10    // How often the runner checks for children that have exited.
+
+    // Seconds after which a test is killed and failed, 0 for no limit. Can be overridden with --timeout=<seconds>.
+    #ifndef SCT_TEST_TIMEOUT
+        #define SCT_TEST_TIMEOUT 0
+    #endif
+
+    // A fixture defined by FIXTURE. `run` sets the fixture up, calls `suite` with `context`
+    // and tears the fixture down.
+    struct sct_internal_fixture {
+        int line;
+        void (*run)(void (*suite)(void* context), void* context);
+    };
+
+    // A test defined by TEST or SUITE. Every test is placed in the sct_tests section, so the
+    // section is a registry of the tests of all compilation units.
+    struct sct_internal_test {
+        char const* description;
+        char const* file;
+        int line;
+        struct sct_internal_fixture const* fixture;     // NULL for a TEST
+        int (*function)(void);
+    };
+
+    extern struct sct_internal_test const __start_sct_tests[] __attribute__ ((weak));
+    extern struct sct_internal_test const __stop_sct_tests[] __attribute__ ((weak));
+
+    // The pipe that the test running in the current process writes its failure message to.
+    __attribute__ ((weak)) int sct_internal_test_fd = -1;
+
+    #define ASSERT_EQUAL(a, b)                                                          \
+        do {                                                                            \
+            typeof(a) evaluated = a;                                                    \
+            if (!IS_EQUAL(evaluated, b)) {                                              \
+                SCT_INTERNAL_TEST_MESSAGES_PUSH(a, b, evaluated);                       \
+                return 1;                                                               \
+            }                                                                           \
+        } while (0)
+
+    #define ASSERT_NOT_EQUAL(a, b)                                  \
+        do {                                                        \
+            typeof(a) evaluated = a;                                \
+            if (IS_EQUAL(evaluated, b)) {                           \
+                SCT_INTERNAL_TEST_MESSAGES_PUSH(a, b, evaluated);   \
+                return 1;                                           \
+            }                                                       \
+        } while (0)
+
+    #define ASSERT_NONE(expr) ASSERT_EQUAL(expr, 0)
+    #define ASSERT_SOME(expr) ASSERT_NOT_EQUAL(expr, 0)
+
+    #define SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "\e[31mFailed test:\e[0m %s (%s:%d)\n   \e[33mExpected:\e[0m %s = %s\n   \e[33mReceived:\e[0m %s = "
+
+    #define SCT_INTERNAL_RESOLVE_TEST_FAILURE_FORMAT(x)                             \
+        _Generic(x,                                                                 \
+            char: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%c\n",                     \
+            unsigned char: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%d\n",            \
+            int: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%d\n",                      \
+            long int: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%ld\n",                \
+            long long: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%lld\n",              \
+            unsigned: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%u\n",                 \
+            unsigned long: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%lu\n",           \
+            unsigned long long: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%llu\n",     \
+            char*: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "\"%s\"\n"                 \
+        )
+
+    #define SCT_INTERNAL_TEST_MESSAGES_PUSH(expr, value, eval)                                          \
+        dprintf(                                                                                        \
+            sct_internal_test_fd,                                                                       \
+            SCT_INTERNAL_RESOLVE_TEST_FAILURE_FORMAT(eval),                                             \
+            __desc, __FILE__, __LINE__, TO_STRING(expr), TO_STRING(value), TO_STRING(expr), eval        \
+        );
+
+    #define SCT_INTERNAL_TEST(description, body, id, declaration, fixture)                  \
+        static int CONCAT(sct_test_, id)(void) {                                            \
+            const char *__desc __attribute__ ((unused)) = description;                      \
+            declaration;                                                                    \
+            body;                                                                           \
+            return 0;                                                                       \
+        }                                                                                   \
+        static struct sct_internal_test const CONCAT(sct_test_entry_, id)                   \
+            __attribute__ ((section("sct_tests"), used, aligned(8))) = {                    \
+                description, __FILE__, __LINE__, fixture, CONCAT(sct_test_, id)             \
+            };
+
+    #define TEST(description, body) SCT_INTERNAL_TEST(description, body, __COUNTER__, , NULL)
+
+    // Define a fixture that is shared by the SUITE tests of `name`. The setup runs with
+    // `type* const fixture` once in a process of its own, before the first test of the suite
+    // starts, and every test inherits the result when it is forked from that process.
+    // The teardown is deferred with DEFER and runs once all the tests of the suite have finished.
+    // If the setup crashes or exits, or hangs for twice the --timeout, the tests of the suite fail
+    // and the run goes on.
+    #define FIXTURE(name, type, setup, teardown)                                            \
+        static type CONCAT(sct_fixture_data_, name);                                        \
+        static void CONCAT(sct_fixture_run_, name)(void (*suite)(void*), void* context) {   \
+            type* const fixture __attribute__ ((unused)) = &CONCAT(sct_fixture_data_, name); \
+            setup;                                                                          \
+            DEFER(teardown);                                                                \
+            suite(context);                                                                 \
+        }                                                                                   \
+        __attribute__ ((unused))                                                            \
+        static struct sct_internal_fixture const CONCAT(sct_fixture_, name) = {             \
+            __LINE__, CONCAT(sct_fixture_run_, name)                                        \
+        }
+
+    // A test that reads the fixture of `name` through `type const* const fixture`.
+    #define SUITE(name, description, body)                                                  \
+        SCT_INTERNAL_TEST(                                                                  \
+            description, body, __COUNTER__,                                                 \
+            typeof(CONCAT(sct_fixture_data_, name)) const* const fixture __attribute__ ((unused)) \
+                = &CONCAT(sct_fixture_data_, name),                                         \
+            &CONCAT(sct_fixture_, name)                                                     \
+        )
+
+    // A test running in a child process, the leader of a process group of its own. The child
+    // writes its failure message to `fd`, which is read into `output` as it arrives.
+    struct sct_internal_test_job {
+        pid_t pid;
+        int fd;                         // -1 once every writer has closed the pipe.
+        FILE* output;                   // The message of the result.
+        unsigned index;
+        int timed_out;
+        unsigned long long start;       // monotonic time in nanoseconds
+    };
+
+    // The outcome of a test. The message is NULL if the test passed, and it is freed once
+    // the result has been reported. The results are in shared memory, so the runner sees
+    // the results that a suite process has reported.
+    struct sct_internal_test_result {
+        int finished;
+        int failed;
+        int reported;
+        char* message;
+        size_t length;                  // The size of the message while it is being read.
+        unsigned long long wall;        // nanoseconds
+        unsigned long long cpu;         // nanoseconds of user and system time
+    };
+
+    static inline unsigned long long sct_internal_test_now(void) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+
+    // GCC may emit the entries of a compilation unit in reverse order, so they are sorted by location.
+    // The tests of a suite are sorted to the location of their fixture, so they run together.
+    static int sct_internal_test_compare_location(void const* const a, void const* const b) {
+        struct sct_internal_test const* const x = *(struct sct_internal_test const* const*) a;
+        struct sct_internal_test const* const y = *(struct sct_internal_test const* const*) b;
+        int const x_group = x->fixture != NULL ? x->fixture->line : x->line;
+        int const y_group = y->fixture != NULL ? y->fixture->line : y->line;
+        int const order = strcmp(x->file, y->file);
+
+        if (order != 0) return order;
+        if (x_group != y_group) return (x_group > y_group) - (x_group < y_group);
+        return (x->line > y->line) - (x->line < y->line);
+    }
+
+    struct sct_internal_test_options {
+        unsigned jobs;
+        int list;
+        char const* filter;
+        unsigned shard_index;
+        unsigned shard_count;
+        double timeout;                 // seconds, 0 for no limit
+        char const* tap;
+        char const* junit;
+    };
+
+    // Options: -j N, --list, --filter=<glob>, --shard=<index>/<count> (the index starts from 0),
+    // --timeout=<seconds>, --tap=<path> and --junit=<path> (a path of - is the standard output).
+    static inline struct sct_internal_test_options sct_internal_test_parse_options(int const argc, char** const argv) {
+        long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        struct sct_internal_test_options options = {
+            .jobs = cpus > 0 ? cpus : 1,
+            .shard_count = 1,
+            .timeout = SCT_TEST_TIMEOUT,
+        };
+
+        for (int i = 1; i < argc; i += 1) {
+            if (strncmp(argv[i], "-j", 2) == 0) {
+                char const* const value = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "1");
+                long const jobs = strtol(value, NULL, 10);
+                options.jobs = jobs > 0 ? jobs : 1;
+            } else if (strcmp(argv[i], "--list") == 0) {
+                options.list = 1;
+            } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+                options.filter = argv[i] + 9;
+            } else if (strncmp(argv[i], "--shard=", 8) == 0) {
+                if (sscanf(argv[i] + 8, "%u/%u", &options.shard_index, &options.shard_count) != 2
+                    || options.shard_count == 0
+                    || options.shard_index >= options.shard_count
+                ) {
+                    PANICF("Invalid shard %s, expected --shard=<index>/<count> with index < count\n", argv[i] + 8);
+                }
+            } else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+                options.timeout = strtod(argv[i] + 10, NULL);
+            } else if (strncmp(argv[i], "--tap=", 6) == 0) {
+                options.tap = argv[i] + 6;
+            } else if (strncmp(argv[i], "--junit=", 8) == 0) {
+                options.junit = argv[i] + 8;
+            }
+        }
+
+        if (options.tap != NULL && options.junit != NULL && strcmp(options.tap, "-") == 0 && strcmp(options.junit, "-") == 0) {
+            PANICF("Only one of --tap and --junit can write to the standard output\n");
+        }
+
+        return options;
+    }
+
+    static inline void sct_internal_test_start(
+        struct sct_internal_test_job* const job,
+        struct sct_internal_test const* const* const tests,
+        struct sct_internal_test_result* const result,
+        unsigned const index
+    ) {
+        int fds[2];
+
+        if (pipe(fds) != 0) {
+            PANICF("Failed to create a pipe for a test\n");
+        }
+        result->message = NULL;
+        job->output = open_memstream(&result->message, &result->length);
+        if (job->output == NULL) {
+            PANICF("Failed to allocate the message of a test\n");
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+
+        job->index = index;
+        job->timed_out = 0;
+        job->start = sct_internal_test_now();
+        job->pid = fork();
+        if (job->pid == -1) {
+            PANICF("Failed to fork a test\n");
+        }
+
+        if (job->pid == 0) {
+            int status;
+            setpgid(0, 0);
+            close(fds[0]);
+            #ifdef DEBUG
+                scti_alloc_forget();
+            #endif
+            sct_internal_test_fd = fds[1];
+            status = tests[index]->function();
+            close(fds[1]);
+            // The child skips the destructors, which belong to the runner: the allocation
+            // profile and the site counters. Only the leaks of the test itself are reported.
+            #ifdef DEBUG
+                scti_check_for_leaks();
+            #endif
+            fflush(stdout);
+            fflush(stderr);
+            _exit(status != 0);
+        }
+
+        // Both sides set the group, so that it exists whichever of them runs first.
+        setpgid(job->pid, job->pid);
+        close(fds[1]);
+        job->fd = fds[0];
+        fcntl(job->fd, F_SETFL, fcntl(job->fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    // Read what a child has written so far into the output of its job, without blocking.
+    // The pipe is closed once every process that holds its other end has closed it.
+    static inline void sct_internal_test_drain(struct sct_internal_test_job* const job) {
+        char buffer[4096];
+
+        while (job->fd != -1) {
+            ssize_t const n = read(job->fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                fwrite(buffer, 1, n, job->output);
+            } else if (n == -1 && errno == EINTR) {
+                continue;
+            } else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
+            } else {
+                close(job->fd);
+                job->fd = -1;
+            }
+        }
+    }
+
+    // Reap the child of a job if it has exited, and measure it. Returns 0 if it is still running.
+    // The output is read into a stream of its own, so failure messages are never truncated.
+    // A process that the child forked may keep the pipe open, so the pipe is not waited for.
+    static inline int sct_internal_test_finish(
+        struct sct_internal_test_job* const job,
+        struct sct_internal_test const* const test,
+        struct sct_internal_test_result* const result
+    ) {
+        struct rusage usage;
+        int status;
+        FILE* const message = job->output;
+        pid_t waited;
+
+        sct_internal_test_drain(job);
+        while ((waited = wait4(job->pid, &status, WNOHANG, &usage)) == -1 && errno == EINTR);
+        if (waited == 0) {
+            return 0;
+        }
+        if (waited == -1) {
+            PANICF("Failed to wait for a test\n");
+        }
+        sct_internal_test_drain(job);
+        if (job->fd != -1) {
+            close(job->fd);
+            job->fd = -1;
+        }
+
+        result->wall = sct_internal_test_now() - job->start;
+        result->cpu = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL
+            + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+
+        fflush(message);
+        size_t const length = result->length;
+        if (job->timed_out) {
+            fprintf(
+                message, "\e[31mFailed test:\e[0m %s (%s:%d)\n   Timed out after %.3f s\n",
+                test->description, test->file, test->line, result->wall / 1e9
+            );
+        } else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            // Output of a passing test is not a failure message.
+        } else if (length == 0) {
+            fprintf(
+                message, "\e[31mFailed test:\e[0m %s (%s:%d)\n   %s %d\n",
+                test->description, test->file, test->line,
+                WIFSIGNALED(status) ? "Crashed with signal" : "Exited with status",
+                WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status)
+            );
+        }
+        fclose(message);
+
+        result->finished = 1;
+        result->failed = job->timed_out || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        if (!result->failed) {
+            free(result->message);
+            result->message = NULL;
+        }
+        return 1;
+    }
+
+    // A sink that the results are streamed to in source order, as soon as they are known.
+    // `report` is called with the 1-based number of the test.
+    struct sct_internal_test_reporter {
+        FILE* stream;
+        void (*begin)(FILE* stream, unsigned test_count);
+        void (*report)(
+            FILE* stream,
+            unsigned number,
+            struct sct_internal_test const* test,
+            struct sct_internal_test_result const* result
+        );
+        void (*end)(
+            FILE* stream,
+            struct sct_internal_test const* const* tests,
+            struct sct_internal_test_result const* results,
+            unsigned test_count,
+            unsigned fail_count
+        );
+    };
+
+    // Write a message without its color codes. Every line after the first one starts with
+    // `indent`, and with `xml` the characters that are special in XML are escaped.
+    static inline void sct_internal_test_write_plain(
+        FILE* const stream,
+        char const* text,
+        char const* const indent,
+        int const xml
+    ) {
+        for (; *text != '\0'; text += 1) {
+            if (*text == '\e') {
+                while (text[1] != '\0' && text[1] != 'm') text += 1;
+                if (text[1] == 'm') text += 1;
+            } else if (*text == '\n') {
+                fputc('\n', stream);
+                if (text[1] != '\0') fputs(indent, stream);
+            } else if (xml && *text == '&') {
+                fputs("&amp;", stream);
+            } else if (xml && *text == '<') {
+                fputs("&lt;", stream);
+            } else if (xml && *text == '>') {
+                fputs("&gt;", stream);
+            } else if (xml && *text == '"') {
+                fputs("&quot;", stream);
+            } else {
+                fputc(*text, stream);
+            }
+        }
+    }
+
+    static void sct_internal_test_console_begin(FILE* const stream, unsigned const test_count) {
+        (void) stream;
+        (void) test_count;
+    }
+
+    static void sct_internal_test_console_report(
+        FILE* const stream,
+        unsigned const number,
+        struct sct_internal_test const* const test,
+        struct sct_internal_test_result const* const result
+    ) {
+        (void) number;
+        fprintf(
+            stream, "%s[%s]\e[0m %s (%s:%d) \e[90m%.3f ms, cpu %.3f ms\e[0m\n",
+            result->failed ? "\e[31m" : "\e[32m", result->failed ? "FAIL" : "PASS",
+            test->description, test->file, test->line, result->wall / 1e6, result->cpu / 1e6
+        );
+        if (result->message != NULL) {
+            fprintf(stream, "%s\n", result->message);
+        }
+    }
+
+    static int sct_internal_test_compare_wall(void const* const a, void const* const b) {
+        unsigned long long const x = (*(struct sct_internal_test_result const* const*) a)->wall;
+        unsigned long long const y = (*(struct sct_internal_test_result const* const*) b)->wall;
+        return (x < y) - (x > y);
+    }
+
+    static void sct_internal_test_console_end(
+        FILE* const stream,
+        struct sct_internal_test const* const* const tests,
+        struct sct_internal_test_result const* const results,
+        unsigned const test_count,
+        unsigned const fail_count
+    ) {
+        struct sct_internal_test_result const** const sorted = calloc(test_count, sizeof(*sorted));
+
+        if (fail_count > 0) {
+            fprintf(stream, "\n\e[31mFailed tests:\e[0m\n");
+            for (unsigned i = 0; i < test_count; i += 1) {
+                if (results[i].failed) {
+                    fprintf(stream, "  %s (%s:%d)\n", tests[i]->description, tests[i]->file, tests[i]->line);
+                }
+            }
+        }
+
+        if (sorted != NULL && test_count > 1) {
+            for (unsigned i = 0; i < test_count; i += 1) {
+                sorted[i] = &results[i];
+            }
+            qsort(sorted, test_count, sizeof(*sorted), sct_internal_test_compare_wall);
+
+            fprintf(stream, "\n\e[34mSlowest tests:\e[0m\n");
+            for (unsigned i = 0; i < test_count && i < SCT_INTERNAL_TEST_SLOWEST_COUNT; i += 1) {
+                struct sct_internal_test const* const test = tests[sorted[i] - results];
+                fprintf(
+                    stream, "  %10.3f ms, cpu %10.3f ms  %s (%s:%d)\n",
+                    sorted[i]->wall / 1e6, sorted[i]->cpu / 1e6, test->description, test->file, test->line
+                );
+            }
+        }
+        free(sorted);
+
+        fprintf(
+            stream, "\n\e[34mTotal:\e[0m %u, \e[32mPass:\e[0m %u, \e[31mFail:\e[0m %u\n",
+            test_count, test_count - fail_count, fail_count
+        );
+    }
+
+    // TAP version 13, the failure message of a test goes into a YAML block under it.
+    static void sct_internal_test_tap_begin(FILE* const stream, unsigned const test_count) {
+        fprintf(stream, "TAP version 13\n1..%u\n", test_count);
+    }
+
+    static void sct_internal_test_tap_report(
+        FILE* const stream,
+        unsigned const number,
+        struct sct_internal_test const* const test,
+        struct sct_internal_test_result const* const result
+    ) {
+        fprintf(stream, "%s %u - ", result->failed ? "not ok" : "ok", number);
+        for (char const* c = test->description; *c != '\0'; c += 1) {
+            if (*c == '#' || *c == '\\') fputc('\\', stream);
+            fputc(*c == '\n' ? ' ' : *c, stream);
+        }
+        fputc('\n', stream);
+
+        if (result->failed) {
+            fprintf(stream, "  ---\n  at: %s:%d\n  duration_ms: %.3f\n", test->file, test->line, result->wall / 1e6);
+            if (result->message != NULL) {
+                fprintf(stream, "  message: |\n    ");
+                sct_internal_test_write_plain(stream, result->message, "    ", 0);
+            }
+            fprintf(stream, "  ...\n");
+        }
+    }
+
+    static void sct_internal_test_tap_end(
+        FILE* const stream,
+        struct sct_internal_test const* const* const tests,
+        struct sct_internal_test_result const* const results,
+        unsigned const test_count,
+        unsigned const fail_count
+    ) {
+        (void) stream;
+        (void) tests;
+        (void) results;
+        (void) test_count;
+        (void) fail_count;
+    }
+
+    // JUnit XML. The number of failures is not known until the end, so the testsuite
+    // element only carries the number of tests.
+    static void sct_internal_test_junit_begin(FILE* const stream, unsigned const test_count) {
+        fprintf(
+            stream, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuite name=\"safetyct\" tests=\"%u\">\n",
+            test_count
+        );
+    }
+
+    static void sct_internal_test_junit_report(
+        FILE* const stream,
+        unsigned const number,
+        struct sct_internal_test const* const test,
+        struct sct_internal_test_result const* const result
+    ) {
+        (void) number;
+        fprintf(stream, "  <testcase name=\"");
+        sct_internal_test_write_plain(stream, test->description, "", 1);
+        fprintf(stream, "\" classname=\"");
+        sct_internal_test_write_plain(stream, test->file, "", 1);
+        fprintf(stream, "\" file=\"");
+        sct_internal_test_write_plain(stream, test->file, "", 1);
+        fprintf(stream, "\" line=\"%d\" time=\"%.6f\"", test->line, result->wall / 1e9);
+
+        if (!result->failed) {
+            fprintf(stream, "/>\n");
+            return;
+        }
+
+        fprintf(stream, ">\n    <failure message=\"Failed test\">");
+        if (result->message != NULL) {
+            sct_internal_test_write_plain(stream, result->message, "", 1);
+        }
+        fprintf(stream, "</failure>\n  </testcase>\n");
+    }
+
+    static void sct_internal_test_junit_end(
+        FILE* const stream,
+        struct sct_internal_test const* const* const tests,
+        struct sct_internal_test_result const* const results,
+        unsigned const test_count,
+        unsigned const fail_count
+    ) {
+        (void) tests;
+        (void) results;
+        (void) test_count;
+        (void) fail_count;
+        fprintf(stream, "</testsuite>\n");
+    }
+
+    // Kill the tests that have run out of time. Returns the milliseconds until the next
+    // deadline, or -1 if there is none.
+    static inline int sct_internal_test_check_timeouts(
+        struct sct_internal_test_job* const jobs,
+        unsigned const job_count,
+        double const timeout
+    ) {
+        unsigned long long const limit = timeout * 1e9;
+        unsigned long long const now = sct_internal_test_now();
+        unsigned long long next = 0;
+
+        if (timeout <= 0) {
+            return -1;
+        }
+
+        for (unsigned i = 0; i < job_count; i += 1) {
+            unsigned long long const deadline = jobs[i].start + limit;
+
+            if (jobs[i].timed_out) {
+                continue;
+            }
+            if (now >= deadline) {
+                kill(-jobs[i].pid, SIGKILL);
+                jobs[i].timed_out = 1;
+            } else if (next == 0 || deadline < next) {
+                next = deadline;
+            }
+        }
+
+        return next == 0 ? -1 : (int) ((next - now + 999999) / 1000000);
+    }
+
+    // A path of - takes over the standard output. Its file descriptor is moved aside, and the
+    // standard output of the runner and of every test is sent to the standard error instead,
+    // so that nothing a test prints ends up in the middle of the results.
+    static inline FILE* sct_internal_test_open(char const* const path) {
+        FILE* stream;
+
+        if (strcmp(path, "-") == 0) {
+            int const fd = dup(STDOUT_FILENO);
+            fflush(stdout);
+            stream = fd != -1 && dup2(STDERR_FILENO, STDOUT_FILENO) != -1 ? fdopen(fd, "w") : NULL;
+        } else {
+            stream = fopen(path, "w");
+        }
+        if (stream == NULL) {
+            PANICF("Failed to open %s for the test results\n", path);
+        }
+        return stream;
+    }
+
+    struct sct_internal_test_runner {
+        struct sct_internal_test_options options;
+        struct sct_internal_test_reporter reporters[SCT_INTERNAL_TEST_REPORTERS_MAX];
+        unsigned reporter_count;
+        struct sct_internal_test const** tests;
+        struct sct_internal_test_result* results;
+        struct sct_internal_test_job* jobs;
+        struct pollfd* fds;
+        unsigned test_count, job_count, started, reported, fail_count;
+        unsigned end;                   // The end of the group of tests that is running.
+        int suite_failed;               // A fixture failed even if its tests passed.
+    };
+
+    // Run the tests from `started` to `end`, `-j N` at a time, and report them in order.
+    static void sct_internal_test_run_group(void* const context) {
+        struct sct_internal_test_runner* const runner = context;
+
+        while (runner->reported < runner->end) {
+            while (runner->job_count < runner->options.jobs && runner->started < runner->end) {
+                sct_internal_test_start(
+                    &runner->jobs[runner->job_count], runner->tests, &runner->results[runner->started], runner->started
+                );
+                runner->job_count += 1;
+                runner->started += 1;
+            }
+
+            // A child closes its end of the pipe when it exits, which wakes the poll, but a process
+            // it forked may keep the pipe open, so the children are also reaped every few milliseconds.
+            // A child whose pipe is closed but who has not been reaped yet is checked every millisecond.
+            int wait = sct_internal_test_check_timeouts(runner->jobs, runner->job_count, runner->options.timeout);
+            for (unsigned i = 0; i < runner->job_count; i += 1) {
+                runner->fds[i] = (struct pollfd) {.fd = runner->jobs[i].fd, .events = POLLIN};
+                int const reap = runner->jobs[i].fd == -1 ? 1 : SCT_INTERNAL_TEST_REAP_MS;
+                wait = wait < 0 || wait > reap ? reap : wait;
+            }
+            if (runner->job_count > 0 && poll(runner->fds, runner->job_count, wait) == -1 && errno != EINTR) {
+                PANICF("Failed to wait for the tests\n");
+            }
+
+            for (unsigned i = runner->job_count; i-- > 0;) {
+                struct sct_internal_test_job* const job = &runner->jobs[i];
+                if (sct_internal_test_finish(job, runner->tests[job->index], &runner->results[job->index])) {
+                    *job = runner->jobs[--runner->job_count];
+                }
+            }
+
+            while (runner->reported < runner->end && runner->results[runner->reported].finished) {
+                struct sct_internal_test_result* const result = &runner->results[runner->reported];
+                for (unsigned r = 0; r < runner->reporter_count; r += 1) {
+                    struct sct_internal_test_reporter const* const reporter = &runner->reporters[r];
+                    reporter->report(reporter->stream, runner->reported + 1, runner->tests[runner->reported], result);
+                    fflush(reporter->stream);
+                }
+                runner->fail_count += result->failed;
+                free(result->message);
+                result->message = NULL;
+                result->reported = 1;
+                runner->reported += 1;
+            }
+        }
+    }
+
+    // Run the tests of a suite in a process of its own, which sets up the fixture, forks the
+    // tests from it and reports them. If the process dies, or no test of the suite finishes in
+    // twice the timeout, the tests that it has not reported fail in the runner. Without a
+    // timeout, a setup that hangs hangs the run like a test that hangs.
+    static void sct_internal_test_run_suite(
+        struct sct_internal_test_runner* const runner,
+        struct sct_internal_fixture const* const fixture
+    ) {
+        unsigned long long const limit = runner->options.timeout > 0 ? runner->options.timeout * 2e9 : 0;
+        unsigned long long progress = sct_internal_test_now();
+        unsigned finished = 0;
+        int status = 0;
+        int timed_out = 0;
+        pid_t waited;
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t const pid = fork();
+        if (pid == -1) {
+            PANICF("Failed to fork a suite\n");
+        }
+
+        if (pid == 0) {
+            fixture->run(sct_internal_test_run_group, runner);
+            fflush(stdout);
+            fflush(stderr);
+            _exit(EXIT_SUCCESS);
+        }
+
+        while ((waited = waitpid(pid, &status, WNOHANG)) == 0 || (waited == -1 && errno == EINTR)) {
+            unsigned count = 0;
+            for (unsigned i = runner->started; i < runner->end; i += 1) {
+                count += __atomic_load_n(&runner->results[i].finished, __ATOMIC_RELAXED);
+            }
+            if (count != finished) {
+                finished = count;
+                progress = sct_internal_test_now();
+            } else if (limit > 0 && !timed_out && sct_internal_test_now() - progress >= limit) {
+                kill(pid, SIGKILL);
+                timed_out = 1;
+            }
+            poll(NULL, 0, 1);
+        }
+
+        for (unsigned i = runner->started; i < runner->end; i += 1) {
+            struct sct_internal_test_result* const result = &runner->results[i];
+            struct sct_internal_test const* const test = runner->tests[i];
+            size_t length = 0;
+            FILE* message;
+
+            if (result->reported) {
+                runner->fail_count += result->failed;
+                continue;
+            }
+
+            // A message that was not reported belongs to the heap of the suite process.
+            result->message = NULL;
+            message = open_memstream(&result->message, &length);
+            if (message != NULL) {
+                fprintf(message, "\e[31mFailed test:\e[0m %s (%s:%d)\n   ", test->description, test->file, test->line);
+                if (timed_out) {
+                    fprintf(message, "The fixture of the suite timed out after %.3f s\n", limit / 1e9);
+                } else if (WIFSIGNALED(status)) {
+                    fprintf(message, "The fixture of the suite crashed with signal %d\n", WTERMSIG(status));
+                } else {
+                    fprintf(message, "The fixture of the suite exited with status %d\n", WEXITSTATUS(status));
+                }
+                fclose(message);
+            }
+
+            result->finished = 1;
+            result->failed = 1;
+            for (unsigned r = 0; r < runner->reporter_count; r += 1) {
+                struct sct_internal_test_reporter const* const reporter = &runner->reporters[r];
+                reporter->report(reporter->stream, i + 1, test, result);
+                fflush(reporter->stream);
+            }
+            runner->fail_count += 1;
+            free(result->message);
+            result->message = NULL;
+            result->reported = 1;
+        }
+
+        if (timed_out || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            runner->suite_failed = 1;
+            ERRORF(
+                "\e[31mThe fixture of the suite at %s:%d failed\e[0m\n",
+                runner->tests[runner->started]->file, fixture->line
+            );
+        }
+
+        runner->started = runner->reported = runner->end;
+    }
+
+    // Run the selected tests, every test in a child process of its own and `-j N` at a time
+    // (the number of CPUs by default). The tests of a suite run as a group inside the setup
+    // and teardown of their fixture. The results are streamed to the reporters in source
+    // order as they come in: the console, unless --tap or --junit writes to the standard
+    // output, and the TAP and JUnit XML files.
+    // The first compilation unit to get here runs the tests of all of them and exits.
+    __attribute__ ((constructor(65535)))
+    static void sct_internal_run_tests(int const argc, char** const argv) {
+        struct sct_internal_test_runner runner = {.options = sct_internal_test_parse_options(argc, argv)};
+        struct sct_internal_test_options const* const options = &runner.options;
+        unsigned const registered = __stop_sct_tests - __start_sct_tests;
+
+        if (registered == 0) {
+            return;
+        }
+
+        runner.tests = calloc(registered, sizeof(*runner.tests));
+        runner.results = mmap(
+            NULL, registered * sizeof(*runner.results), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0
+        );
+        if (runner.results == MAP_FAILED) {
+            runner.results = NULL;
+        }
+        runner.jobs = calloc(options->jobs, sizeof(*runner.jobs));
+        runner.fds = calloc(options->jobs, sizeof(*runner.fds));
+        if (runner.tests == NULL || runner.results == NULL || runner.jobs == NULL || runner.fds == NULL) {
+            PANICF("Failed to allocate the test runner\n");
+        }
+
+        for (unsigned i = 0; i < registered; i += 1) {
+            if (options->filter == NULL || fnmatch(options->filter, __start_sct_tests[i].description, 0) == 0) {
+                runner.tests[runner.test_count++] = &__start_sct_tests[i];
+            }
+        }
+        qsort(runner.tests, runner.test_count, sizeof(*runner.tests), sct_internal_test_compare_location);
+
+        // The shards split the filtered tests, so every shard gets a similar share of them.
+        if (options->shard_count > 1) {
+            unsigned sharded = 0;
+            for (unsigned i = options->shard_index; i < runner.test_count; i += options->shard_count) {
+                runner.tests[sharded++] = runner.tests[i];
+            }
+            runner.test_count = sharded;
+        }
+
+        if (options->list) {
+            for (unsigned i = 0; i < runner.test_count; i += 1) {
+                printf("%s (%s:%d)\n", runner.tests[i]->description, runner.tests[i]->file, runner.tests[i]->line);
+            }
+            exit(EXIT_SUCCESS);
+        }
+
+        if ((options->tap == NULL || strcmp(options->tap, "-") != 0)
+            && (options->junit == NULL || strcmp(options->junit, "-") != 0)
+        ) {
+            runner.reporters[runner.reporter_count++] = (struct sct_internal_test_reporter) {
+                stdout, sct_internal_test_console_begin, sct_internal_test_console_report, sct_internal_test_console_end
+            };
+        }
+        if (options->tap != NULL) {
+            runner.reporters[runner.reporter_count++] = (struct sct_internal_test_reporter) {
+                sct_internal_test_open(options->tap),
+                sct_internal_test_tap_begin, sct_internal_test_tap_report, sct_internal_test_tap_end
+            };
+        }
+        if (options->junit != NULL) {
+            runner.reporters[runner.reporter_count++] = (struct sct_internal_test_reporter) {
+                sct_internal_test_open(options->junit),
+                sct_internal_test_junit_begin, sct_internal_test_junit_report, sct_internal_test_junit_end
+            };
+        }
+
+        // The reporters are flushed after every write, so a forked child never inherits
+        // buffered output that it would write again when it exits.
+        for (unsigned r = 0; r < runner.reporter_count; r += 1) {
+            runner.reporters[r].begin(runner.reporters[r].stream, runner.test_count);
+            fflush(runner.reporters[r].stream);
+        }
+
+        while (runner.started < runner.test_count) {
+            struct sct_internal_fixture const* const fixture = runner.tests[runner.started]->fixture;
+
+            runner.end = runner.started + 1;
+            while (runner.end < runner.test_count && runner.tests[runner.end]->fixture == fixture) {
+                runner.end += 1;
+            }
+
+            if (fixture != NULL) {
+                sct_internal_test_run_suite(&runner, fixture);
+            } else {
+                sct_internal_test_run_group(&runner);
+            }
+        }
+
+        for (unsigned r = 0; r < runner.reporter_count; r += 1) {
+            struct sct_internal_test_reporter const* const reporter = &runner.reporters[r];
+            reporter->end(reporter->stream, runner.tests, runner.results, runner.test_count, runner.fail_count);
+            if (reporter->stream != stdout) {
+                fclose(reporter->stream);
+            }
+        }
+        exit(runner.fail_count > 0 || runner.suite_failed ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+#else
+
+    #define TEST(description, body)
+    #define FIXTURE(name, type, setup, teardown)
+    #define SUITE(name, description, body)
+    #define ASSERT_EQUAL(a, b) CRASH_IF((a) != (b))
+    #define ASSERT_NOT_EQUAL(a, b) CRASH_IF((a) == (b))
+    #define ASSERT_NONE(error) CRASH_IF((error) != 0)
+    #define ASSERT_SOME(error) CRASH_IF((error) == 0)
+
+#endif
+
+//
+//  BENCHMARK MODE: Run benchmarks defined in the source files (behind -DBENCH)
+//
+
+// The BENCH flag has the name of the BENCH macro, so it is replaced by SCT_INTERNAL_BENCH_MODE.
+#ifdef BENCH
+    #undef BENCH
+    #define SCT_INTERNAL_BENCH_MODE
+#endif
+
+#ifdef SCT_INTERNAL_BENCH_MODE
+
+    #include <fnmatch.h>
+    #include <time.h>
+
+    // Samples taken of every benchmark, each one is the average of a calibrated batch of iterations.
+    #ifndef SCT_BENCH_REPETITIONS
+        #define SCT_BENCH_REPETITIONS 30
+    #endif
+
+    // The duration a batch of iterations is calibrated to, and the duration of the warm-up.
+    #ifndef SCT_BENCH_BATCH_NS
+        #define SCT_BENCH_BATCH_NS 10000000ULL
+    #endif
+
+    // The one-sided z-score above which a benchmark is significantly slower than its baseline (p < 0.05).
+    #ifndef SCT_BENCH_Z_CRITICAL
+        #define SCT_BENCH_Z_CRITICAL 1.645
+    #endif
+
+    // A benchmark defined by BENCH, placed in the sct_benches section like tests are in sct_tests.
+    struct sct_internal_bench {
+        char const* description;
+        char const* file;
+        int line;
+        void (*function)(unsigned long long iterations);
+    };
+
+    extern struct sct_internal_bench const __start_sct_benches[] __attribute__ ((weak));
+    extern struct sct_internal_bench const __stop_sct_benches[] __attribute__ ((weak));
+
+    struct sct_internal_bench_result {
+        struct sct_internal_bench const* bench;
+        unsigned long long iterations;      // per sample
+        double samples[SCT_BENCH_REPETITIONS];  // ns/op, sorted
+    };
+
+    // The samples of a benchmark in a baseline file, matched to the benchmarks by description.
+    struct sct_internal_bench_baseline {
+        char* description;
+        unsigned count;
+        double samples[SCT_BENCH_REPETITIONS];  // sorted
+    };
+
+    // Keep the compiler from optimizing away a value that the benchmark computes.
+    #define BENCH_KEEP(value) __asm__ volatile ("" : : "g" (value) : "memory")
+
+    #define SCT_INTERNAL_BENCH(description, body, id)                                       \
+        static void CONCAT(sct_bench_, id)(unsigned long long const sct_internal_iterations) { \
+            for (unsigned long long sct_internal_iteration = 0;                             \
+                sct_internal_iteration < sct_internal_iterations;                           \
+                sct_internal_iteration += 1                                                 \
+            ) {                                                                             \
+                body;                                                                       \
+                __asm__ volatile ("" : : : "memory");                                       \
+            }                                                                               \
+        }                                                                                   \
+        static struct sct_internal_bench const CONCAT(sct_bench_entry_, id)                 \
+            __attribute__ ((section("sct_benches"), used, aligned(8))) = {                  \
+                description, __FILE__, __LINE__, CONCAT(sct_bench_, id)                     \
+            };
+
+    #define BENCH(description, body) SCT_INTERNAL_BENCH(description, body, __COUNTER__)
+
+    static inline unsigned long long sct_internal_bench_now(void) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+
+    // Run a batch of iterations and return its duration in nanoseconds. The barriers keep
+    // the compiler from moving work across the clock reads.
+    static inline unsigned long long sct_internal_bench_time(
+        struct sct_internal_bench const* const bench,
+        unsigned long long const iterations
+    ) {
+        unsigned long long start, end;
+
+        __asm__ volatile ("" : : : "memory");
+        start = sct_internal_bench_now();
+        __asm__ volatile ("" : : : "memory");
+        bench->function(iterations);
+        __asm__ volatile ("" : : : "memory");
+        end = sct_internal_bench_now();
+        __asm__ volatile ("" : : : "memory");
+
+        return end - start;
+    }
+
+    // GCC may emit the entries of a compilation unit in reverse order, so they are sorted by location.
+    static int sct_internal_bench_compare_location(void const* const a, void const* const b) {
+        struct sct_internal_bench const* const x = ((struct sct_internal_bench_result const*) a)->bench;
+        struct sct_internal_bench const* const y = ((struct sct_internal_bench_result const*) b)->bench;
+        int const order = strcmp(x->file, y->file);
+        return order != 0 ? order : (x->line > y->line) - (x->line < y->line);
+    }
+
+    static int sct_internal_bench_compare(void const* const a, void const* const b) {
+        double const x = *(double const*) a;
+        double const y = *(double const*) b;
+        return (x > y) - (x < y);
+    }
+
+    // The nearest-rank percentile of sorted samples.
+    static inline double sct_internal_bench_percentile(double const* const samples, unsigned const count, unsigned const percent) {
+        unsigned const rank = (percent * count + 99) / 100;
+        return samples[rank > 0 ? rank - 1 : 0];
+    }
+
+    // Double the iterations until a batch takes SCT_BENCH_BATCH_NS, warm up for as long,
+    // then take SCT_BENCH_REPETITIONS samples.
+    static inline void sct_internal_bench_run(struct sct_internal_bench_result* const result) {
+        unsigned long long iterations = 1, elapsed, warm_up = 0;
+
+        while ((elapsed = sct_internal_bench_time(result->bench, iterations)) < SCT_BENCH_BATCH_NS
+            && iterations < (1ULL << 62)
+        ) {
+            iterations = elapsed < SCT_BENCH_BATCH_NS / 1024 ? iterations * 16 : iterations * 2;
+        }
+        while (warm_up < SCT_BENCH_BATCH_NS) {
+            warm_up += sct_internal_bench_time(result->bench, iterations);
+        }
+
+        result->iterations = iterations;
+        for (unsigned i = 0; i < SCT_BENCH_REPETITIONS; i += 1) {
+            result->samples[i] = (double) sct_internal_bench_time(result->bench, iterations) / iterations;
+        }
+        qsort(result->samples, SCT_BENCH_REPETITIONS, sizeof(double), sct_internal_bench_compare);
+    }
+
+    // The square root by Newton's method, instead of sqrt, so that building with -DBENCH does not
+    // need libm to be linked with -lm. It runs once per benchmark and stops when the root settles.
+    static inline double sct_internal_bench_sqrt(double const x) {
+        double y = x > 1 ? x : 1, previous = 0;
+        for (int i = 0; i < 64 && x > 0 && y != previous; i += 1) {
+            previous = y;
+            y = (y + x / y) / 2;
+        }
+        return x > 0 ? y : 0;
+    }
+
+    // The z-score of the Mann-Whitney U test that `samples` are larger than `baseline`, with
+    // average ranks for ties and a tie-corrected variance. Both sample arrays must be sorted.
+    static inline double sct_internal_bench_mann_whitney(
+        double const* const samples,
+        unsigned const n1,
+        double const* const baseline,
+        unsigned const n2
+    ) {
+        double const n = n1 + n2;
+        double rank_sum = 0, ties = 0, variance;
+        unsigned i = 0, j = 0;
+
+        // Merge the sorted samples, giving every group of equal values the average of its ranks.
+        while (i < n1 || j < n2) {
+            double const value = i < n1 && (j >= n2 || samples[i] <= baseline[j]) ? samples[i] : baseline[j];
+            unsigned const first = i + j;
+            unsigned from_samples = 0;
+
+            while (i < n1 && samples[i] == value) {
+                i += 1;
+                from_samples += 1;
+            }
+            while (j < n2 && baseline[j] == value) {
+                j += 1;
+            }
+
+            double const group = i + j - first;
+            rank_sum += from_samples * (first + 1 + i + j) / 2.0;
+            ties += group * group * group - group;
+        }
+
+        variance = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1)));
+        if (variance <= 0) {
+            return 0;
+        }
+        // U minus its mean, with a continuity correction towards zero.
+        double const u = rank_sum - n1 * (n1 + 1) / 2.0 - n1 * n2 / 2.0;
+        return (u > 0.5 ? u - 0.5 : u < -0.5 ? u + 0.5 : 0) / sct_internal_bench_sqrt(variance);
+    }
+
+    // Print the result, compared to its baseline if there is one.
+    // Returns 1 if the benchmark is significantly slower and its p50 regressed by more than `threshold` percent.
+    static inline int sct_internal_bench_print(
+        struct sct_internal_bench_result const* const result,
+        struct sct_internal_bench_baseline const* const baseline,
+        double const threshold
+    ) {
+        double const p50 = sct_internal_bench_percentile(result->samples, SCT_BENCH_REPETITIONS, 50);
+        double const p99 = sct_internal_bench_percentile(result->samples, SCT_BENCH_REPETITIONS, 99);
+        double change = 0, z = 0;
+        int failed = 0;
+
+        if (baseline != NULL) {
+            double const baseline_p50 = sct_internal_bench_percentile(baseline->samples, baseline->count, 50);
+            change = baseline_p50 > 0 ? (p50 - baseline_p50) / baseline_p50 * 100 : 0;
+            z = sct_internal_bench_mann_whitney(result->samples, SCT_BENCH_REPETITIONS, baseline->samples, baseline->count);
+            failed = z > SCT_BENCH_Z_CRITICAL && change > threshold;
+        }
+
+        printf(
+            "%s\e[0m %s (%s:%d)\n   p50 %.2f ns/op, p99 %.2f ns/op, %.0f ops/sec (%u x %llu iterations)\n",
+            baseline == NULL ? "\e[34m[BENCH]" : failed ? "\e[31m[FAIL]" : "\e[32m[PASS]",
+            result->bench->description, result->bench->file, result->bench->line,
+            p50, p99, p50 > 0 ? 1e9 / p50 : 0.0, SCT_BENCH_REPETITIONS, result->iterations
+        );
+        if (baseline != NULL) {
+            printf(
+                "   \e[33mBaseline:\e[0m p50 %.2f ns/op, %+.1f%%, z = %.2f\n",
+                sct_internal_bench_percentile(baseline->samples, baseline->count, 50), change, z
+            );
+        }
+        fflush(stdout);
+
+        return failed;
+    }
+
+    // Write a string with the characters that are special in a JSON string escaped, so that
+    // neither the JSON results nor the lines of a baseline file are broken by a description.
+    static inline void sct_internal_bench_write_escaped(FILE* const file, char const* text) {
+        for (; *text != '\0'; text += 1) {
+            if (*text == '"' || *text == '\\') {
+                fputc('\\', file);
+                fputc(*text, file);
+            } else if (*text == '\n') {
+                fputs("\\n", file);
+            } else if (*text == '\t') {
+                fputs("\\t", file);
+            } else if ((unsigned char) *text < 0x20) {
+                fprintf(file, "\\u%04x", (unsigned char) *text);
+            } else {
+                fputc(*text, file);
+            }
+        }
+    }
+
+    // Undo sct_internal_bench_write_escaped in place.
+    static inline void sct_internal_bench_unescape(char* const text) {
+        char* out = text;
+        for (char const* in = text; *in != '\0'; in += 1) {
+            if (*in != '\\' || in[1] == '\0') {
+                *out++ = *in;
+                continue;
+            }
+            in += 1;
+            if (*in == 'n') {
+                *out++ = '\n';
+            } else if (*in == 't') {
+                *out++ = '\t';
+            } else if (*in == 'u' && strlen(in) >= 5) {
+                char code[5] = {in[1], in[2], in[3], in[4], '\0'};
+                *out++ = (char) strtol(code, NULL, 16);
+                in += 4;
+            } else {
+                *out++ = *in;
+            }
+        }
+        *out = '\0';
+    }
+
+    // Read a baseline file written by --save-baseline. Every line is an escaped description, a tab
+    // and the samples separated by spaces.
+    static inline struct sct_internal_bench_baseline* sct_internal_bench_read_baseline(
+        char const* const path,
+        unsigned* const count
+    ) {
+        struct sct_internal_bench_baseline* baselines = NULL;
+        unsigned capacity = 0;
+        size_t size = 0;
+        char* line = NULL;
+        FILE* const file = fopen(path, "r");
+
+        *count = 0;
+        if (file == NULL) {
+            PANICF("Failed to open the baseline %s\n", path);
+        }
+
+        while (getline(&line, &size, file) > 0) {
+            char* const tab = strrchr(line, '\t');
+            char* cursor;
+
+            if (line[0] == '#' || tab == NULL) {
+                continue;
+            }
+            if (*count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                baselines = realloc(baselines, capacity * sizeof(*baselines));
+                if (baselines == NULL) {
+                    PANICF("Failed to allocate the baseline\n");
+                }
+            }
+
+            struct sct_internal_bench_baseline* const baseline = &baselines[*count];
+            *tab = '\0';
+            sct_internal_bench_unescape(line);
+            baseline->description = strdup(line);
+            baseline->count = 0;
+            cursor = tab + 1;
+            while (baseline->count < SCT_BENCH_REPETITIONS) {
+                char* end;
+                double const sample = strtod(cursor, &end);
+                if (end == cursor) {
+                    break;
+                }
+                baseline->samples[baseline->count++] = sample;
+                cursor = end;
+            }
+            if (baseline->count > 0) {
+                qsort(baseline->samples, baseline->count, sizeof(double), sct_internal_bench_compare);
+                *count += 1;
+            }
+        }
+
+        free(line);
+        fclose(file);
+        return baselines;
+    }
+
+    static inline void sct_internal_bench_write_baseline(
+        FILE* const file,
+        struct sct_internal_bench_result const* const results,
+        unsigned const count
+    ) {
+        fprintf(file, "# SafetyCT benchmark baseline: escaped description, tab, samples in ns/op\n");
+        for (unsigned i = 0; i < count; i += 1) {
+            sct_internal_bench_write_escaped(file, results[i].bench->description);
+            fputc('\t', file);
+            for (unsigned j = 0; j < SCT_BENCH_REPETITIONS; j += 1) {
+                fprintf(file, "%s%.6g", j > 0 ? " " : "", results[i].samples[j]);
+            }
+            fprintf(file, "\n");
+        }
+    }
+
+    static inline void sct_internal_bench_write_json(
+        FILE* const file,
+        struct sct_internal_bench_result const* const results,
+        unsigned const count
+    ) {
+        fprintf(file, "[\n");
+        for (unsigned i = 0; i < count; i += 1) {
+            struct sct_internal_bench_result const* const result = &results[i];
+            double const p50 = sct_internal_bench_percentile(result->samples, SCT_BENCH_REPETITIONS, 50);
+
+            fprintf(file, "  {\"name\": \"");
+            sct_internal_bench_write_escaped(file, result->bench->description);
+            fprintf(file, "\", \"file\": \"");
+            sct_internal_bench_write_escaped(file, result->bench->file);
+            fprintf(
+                file, "\", \"line\": %d, \"iterations\": %llu, "
+                "\"p50_ns\": %.3f, \"p99_ns\": %.3f, \"ops_per_sec\": %.1f, \"samples_ns\": [",
+                result->bench->line, result->iterations,
+                p50, sct_internal_bench_percentile(result->samples, SCT_BENCH_REPETITIONS, 99), p50 > 0 ? 1e9 / p50 : 0.0
+            );
+            for (unsigned j = 0; j < SCT_BENCH_REPETITIONS; j += 1) {
+                fprintf(file, "%s%.3f", j > 0 ? ", " : "", result->samples[j]);
+            }
+            fprintf(file, "]}%s\n", i + 1 < count ? "," : "");
+        }
+        fprintf(file, "]\n");
+    }
+
+    static inline void sct_internal_bench_write(
+        char const* const path,
+        void (*const write)(FILE*, struct sct_internal_bench_result const*, unsigned),
+        struct sct_internal_bench_result const* const results,
+        unsigned const count
+    ) {
+        FILE* const file = fopen(path, "w");
+        if (file == NULL) {
+            PANICF("Failed to open %s\n", path);
+        }
+        write(file, results, count);
+        fclose(file);
+    }
+
+    // Run the benchmarks of all compilation units in this process, one after another.
+    // Options:
+    //  --filter=<glob>             run the matching benchmarks only
+    //  --json=<path>               also write the results as JSON
+    //  --save-baseline=<path>      write the samples to a baseline file
+    //  --baseline=<path>           compare to a baseline file, exits with a failure on a regression
+    //  --threshold=<percent>       the p50 change that counts as a regression, 5 by default
+    __attribute__ ((constructor(65535)))
+    static void sct_internal_run_benches(int const argc, char** const argv) {
+        unsigned const registered = __stop_sct_benches - __start_sct_benches;
+        struct sct_internal_bench_baseline* baselines = NULL;
+        struct sct_internal_bench_result* results;
+        char const* filter = NULL;
+        char const* json = NULL;
+        char const* save_baseline = NULL;
+        char const* baseline_path = NULL;
+        double threshold = 5;
+        unsigned count = 0, baseline_count = 0, fail_count = 0;
+
+        if (registered == 0) {
+            return;
+        }
+
+        for (int i = 1; i < argc; i += 1) {
+            if (strncmp(argv[i], "--filter=", 9) == 0) {
+                filter = argv[i] + 9;
+            } else if (strncmp(argv[i], "--json=", 7) == 0) {
+                json = argv[i] + 7;
+            } else if (strncmp(argv[i], "--save-baseline=", 16) == 0) {
+                save_baseline = argv[i] + 16;
+            } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+                baseline_path = argv[i] + 11;
+            } else if (strncmp(argv[i], "--threshold=", 12) == 0) {
+                threshold = strtod(argv[i] + 12, NULL);
+            }
+        }
+
+        if (baseline_path != NULL) {
+            baselines = sct_internal_bench_read_baseline(baseline_path, &baseline_count);
+        }
+
+        results = calloc(registered, sizeof(*results));
+        if (results == NULL) {
+            PANICF("Failed to allocate the benchmark results\n");
+        }
+
+        for (unsigned i = 0; i < registered; i += 1) {
+            if (filter == NULL || fnmatch(filter, __start_sct_benches[i].description, 0) == 0) {
+                results[count++].bench = &__start_sct_benches[i];
+            }
+        }
+        qsort(results, count, sizeof(*results), sct_internal_bench_compare_location);
+
+        for (unsigned i = 0; i < count; i += 1) {
+            struct sct_internal_bench_baseline const* baseline = NULL;
+
+            for (unsigned j = 0; j < baseline_count && baseline == NULL; j += 1) {
+                if (strcmp(baselines[j].description, results[i].bench->description) == 0) {
+                    baseline = &baselines[j];
+                }
+            }
+
+            sct_internal_bench_run(&results[i]);
+            fail_count += sct_internal_bench_print(&results[i], baseline, threshold);
+        }
+
+        if (json != NULL) {
+            sct_internal_bench_write(json, sct_internal_bench_write_json, results, count);
+        }
+        if (save_baseline != NULL) {
+            sct_internal_bench_write(save_baseline, sct_internal_bench_write_baseline, results, count);
+        }
+
+        if (baseline_path != NULL) {
+            printf(
+                "\n\e[34mTotal:\e[0m %u, \e[32mPass:\e[0m %u, \e[31mFail:\e[0m %u\n",
+                count, count - fail_count, fail_count
+            );
+        }
+        exit(fail_count > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+#else
+
+    #define BENCH(description, body)
+    #define BENCH_KEEP(value) ((void) (value))
+
+#endif
+
+//
+//  FUZZING MODE: Run fuzz targets defined in the source files in-process (behind -DFUZZ)
+//
+
+// The FUZZ flag has the name of the FUZZ macro, so it is replaced by SCT_INTERNAL_FUZZ_MODE.
+#ifdef FUZZ
+    #undef FUZZ
+    #define SCT_INTERNAL_FUZZ_MODE
+#endif
+
+// The directory of the saved inputs, every fuzz target has a subdirectory named after it.
+// The inputs are replayed as tests with -DTESTS.
+#ifndef SCT_FUZZ_CORPUS
+    #define SCT_FUZZ_CORPUS "fuzz-corpus"
+#endif
+
+// Seconds that one input may run before it is saved as a hang, or fails its replay with -DTESTS.
+// Can be overridden with --timeout=<seconds> when fuzzing.
+#ifndef SCT_FUZZ_TIMEOUT
+    #define SCT_FUZZ_TIMEOUT 5
+#endif
+
+#if defined(SCT_INTERNAL_FUZZ_MODE) || defined(TESTS)
+
+    #include <dirent.h>
+    #include <sys/stat.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+
+    #define SCT_INTERNAL_FUZZ_FUNCTION(description, data, size, body, id)                   \
+        static int CONCAT(sct_fuzz_, id)(                                                   \
+            unsigned char const* const data __attribute__ ((unused)),                       \
+            size_t const size __attribute__ ((unused))                                      \
+        ) {                                                                                 \
+            const char *__desc __attribute__ ((unused)) = description;                      \
+            body;                                                                           \
+            return 0;                                                                       \
+        }
+
+    // The corpus directory of a fuzz target, slashes in the description are replaced with underscores.
+    static inline void sct_internal_fuzz_directory(
+        char* const buffer,
+        size_t const capacity,
+        char const* const corpus,
+        char const* const description
+    ) {
+        int const length = snprintf(buffer, capacity, "%s/", corpus);
+
+        snprintf(buffer + length, capacity - length, "%s", description);
+        for (char* c = buffer + length; *c != '\0'; c += 1) {
+            if (*c == '/') *c = '_';
+        }
+    }
+
+    // Read a whole file into memory, at most `limit` bytes of it. Returns NULL if it cannot be read.
+    // The block has exactly the size of the input, so that a sanitizer catches reads past its end.
+    static inline unsigned char* sct_internal_fuzz_read(char const* const path, size_t const limit, size_t* const size) {
+        FILE* const file = fopen(path, "rb");
+        struct stat info;
+        unsigned char* data;
+
+        if (file == NULL) {
+            return NULL;
+        }
+        if (fstat(fileno(file), &info) != 0 || !S_ISREG(info.st_mode)) {
+            fclose(file);
+            return NULL;
+        }
+
+        *size = (size_t) info.st_size < limit ? (size_t) info.st_size : limit;
+        data = malloc(*size);
+        if (data != NULL) {
+            *size = fread(data, 1, *size, file);
+        }
+        fclose(file);
+
+        return data;
+    }
+
+#endif
+
+#ifdef SCT_INTERNAL_FUZZ_MODE
+
+    #include <fnmatch.h>
+    #include <signal.h>
+    #include <stdint.h>
+    #include <sys/mman.h>
+    #include <time.h>
+
+    // The largest input that is generated.
+    #ifndef SCT_FUZZ_MAX_LENGTH
+        #define SCT_FUZZ_MAX_LENGTH 4096
+    #endif
+
+    // Seconds that every fuzz target runs for. Can be overridden with --time=<seconds>.
+    #ifndef SCT_FUZZ_TIME
+        #define SCT_FUZZ_TIME 10
+    #endif
+
+    // Bytes of edge counters filled by the coverage callback, a power of two.
+    #ifndef SCT_FUZZ_MAP_SIZE
+        #define SCT_FUZZ_MAP_SIZE (1 << 16)
+    #endif
+
+    // The fuzzer itself is not instrumented, so only the code under test adds coverage.
+    #if defined(__has_attribute)
+        #if __has_attribute(no_sanitize_coverage)
+            #define SCT_INTERNAL_FUZZ_UNCOVERED __attribute__ ((no_sanitize_coverage))
+        #endif
+    #endif
+    #ifndef SCT_INTERNAL_FUZZ_UNCOVERED
+        #define SCT_INTERNAL_FUZZ_UNCOVERED
+    #endif
+
+    // A fuzz target defined by FUZZ, placed in the sct_fuzzers section like tests are in sct_tests.
+    struct sct_internal_fuzzer {
+        char const* description;
+        char const* file;
+        int line;
+        int (*function)(unsigned char const* data, size_t size);
+    };
+
+    extern struct sct_internal_fuzzer const __start_sct_fuzzers[] __attribute__ ((weak));
+    extern struct sct_internal_fuzzer const __stop_sct_fuzzers[] __attribute__ ((weak));
+
+    #define SCT_INTERNAL_FUZZ(description, data, size, body, id)                            \
+        SCT_INTERNAL_FUZZ_FUNCTION(description, data, size, body, id)                       \
+        static struct sct_internal_fuzzer const CONCAT(sct_fuzz_entry_, id)                 \
+            __attribute__ ((section("sct_fuzzers"), used, aligned(8))) = {                  \
+                description, __FILE__, __LINE__, CONCAT(sct_fuzz_, id)                      \
+            };
+
+    #define FUZZ(description, data, size, body) SCT_INTERNAL_FUZZ(description, data, size, body, __COUNTER__)
+
+    // Edge counters of the input that is running, filled when the code is compiled with
+    // -fsanitize-coverage=trace-pc. Without it the inputs are only mutated at random.
+    // The indices of the counters that are not zero are listed in `touched`, so collecting
+    // the coverage of an input does not scan the whole map.
+    __attribute__ ((weak)) unsigned char sct_internal_fuzz_map[SCT_FUZZ_MAP_SIZE];
+    __attribute__ ((weak)) unsigned sct_internal_fuzz_touched[SCT_FUZZ_MAP_SIZE];
+    __attribute__ ((weak)) unsigned sct_internal_fuzz_touched_count;
+    _Thread_local uintptr_t sct_internal_fuzz_previous __attribute__ ((weak));
+
+    void __sanitizer_cov_trace_pc(void);
+
+    // GCC calls this at the start of every basic block. The block and the one before it
+    // are hashed into an edge, like AFL does.
+    SCT_INTERNAL_FUZZ_UNCOVERED __attribute__ ((weak)) void __sanitizer_cov_trace_pc(void) {
+        uintptr_t const pc = (uintptr_t) __builtin_return_address(0);
+        unsigned const edge = (pc ^ sct_internal_fuzz_previous) & (SCT_FUZZ_MAP_SIZE - 1);
+        unsigned char const hits = sct_internal_fuzz_map[edge];
+
+        if (hits == 0) {
+            sct_internal_fuzz_touched[sct_internal_fuzz_touched_count++] = edge;
+        }
+        sct_internal_fuzz_map[edge] = hits + (hits != 255);
+        sct_internal_fuzz_previous = pc >> 1;
+    }
+
+    // Shared between the runner and the child that fuzzes, so the runner can save the input
+    // that was running when the child crashed.
+    struct sct_internal_fuzz_shared {
+        unsigned long long executions;
+        unsigned long long corpus;          // inputs in the corpus of the child
+        unsigned long long features;        // edges and hit count buckets covered
+        size_t size;
+        unsigned char data[SCT_FUZZ_MAX_LENGTH];
+    };
+
+    struct sct_internal_fuzz_input {
+        unsigned char* data;
+        size_t size;
+    };
+
+    struct sct_internal_fuzz_options {
+        char const* filter;
+        char const* corpus;
+        double time;                        // seconds per fuzz target
+        double timeout;                     // seconds per input
+        unsigned long long runs;            // inputs per fuzz target, 0 for no limit
+        unsigned long long seed;
+    };
+
+    static inline unsigned long long sct_internal_fuzz_now(void) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+
+    SCT_INTERNAL_FUZZ_UNCOVERED static inline unsigned long long sct_internal_fuzz_random(unsigned long long* const state) {
+        *state ^= *state >> 12;
+        *state ^= *state << 25;
+        *state ^= *state >> 27;
+        return *state * 0x2545F4914F6CDD1DULL;
+    }
+
+    // Apply one random mutation to the input, whose length is kept at most SCT_FUZZ_MAX_LENGTH.
+    SCT_INTERNAL_FUZZ_UNCOVERED static inline void sct_internal_fuzz_mutate(
+        unsigned char* const data,
+        size_t* const size,
+        struct sct_internal_fuzz_input const* const corpus,
+        size_t const corpus_count,
+        unsigned long long* const state
+    ) {
+        static unsigned char const interesting[] = {0, 1, 7, 8, 16, 32, 64, 100, 127, 128, 255, '\n', '0', ' '};
+        unsigned long long const random = sct_internal_fuzz_random(state);
+        size_t const at = *size > 0 ? (random >> 8) % *size : 0;
+        unsigned const operation = *size == 0 ? 3 : random % 8;
+
+        switch (operation) {
+            case 0:
+                data[at] ^= 1 << ((random >> 40) % 8);
+                break;
+            case 1:
+                data[at] = random >> 40;
+                break;
+            case 2:
+                data[at] = interesting[(random >> 40) % sizeof(interesting)];
+                break;
+            case 3:
+                if (*size < SCT_FUZZ_MAX_LENGTH) {
+                    memmove(data + at + 1, data + at, *size - at);
+                    data[at] = random >> 40;
+                    *size += 1;
+                }
+                break;
+            case 4: {
+                size_t const length = 1 + (random >> 40) % (*size - at < 8 ? *size - at : 8);
+                memmove(data + at, data + at + length, *size - at - length);
+                *size -= length;
+                break;
+            }
+            case 5:
+                data[at] += (int) ((random >> 40) % 35) - 17;
+                break;
+            case 6: {
+                size_t const from = (random >> 40) % *size;
+                size_t const length = 1 + (random >> 52) % (*size - (at > from ? at : from));
+                memmove(data + at, data + from, length);
+                break;
+            }
+            case 7: {
+                // Splice: keep the start of the input and continue with the end of another one.
+                struct sct_internal_fuzz_input const* const other = &corpus[(random >> 40) % corpus_count];
+                size_t const from = other->size > 0 ? (random >> 52) % other->size : 0;
+                size_t const length = other->size - from < SCT_FUZZ_MAX_LENGTH - at ? other->size - from : SCT_FUZZ_MAX_LENGTH - at;
+                memcpy(data + at, other->data + from, length);
+                *size = at + length;
+                break;
+            }
+        }
+    }
+
+    // AFL's hit count buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and 128-255.
+    SCT_INTERNAL_FUZZ_UNCOVERED static inline unsigned char sct_internal_fuzz_bucket(unsigned char const count) {
+        if (count <= 3) return 1 << (count - 1);
+        if (count <= 7) return 1 << 3;
+        if (count <= 15) return 1 << 4;
+        if (count <= 31) return 1 << 5;
+        if (count <= 127) return 1 << 6;
+        return 1 << 7;
+    }
+
+    // Add the hit count buckets of the last input to `seen` and clear its counters.
+    // Returns the number of new features, the input is kept in the corpus if there are any.
+    SCT_INTERNAL_FUZZ_UNCOVERED static inline unsigned sct_internal_fuzz_collect(unsigned char* const seen) {
+        unsigned features = 0;
+
+        for (unsigned i = 0; i < sct_internal_fuzz_touched_count; i += 1) {
+            unsigned const edge = sct_internal_fuzz_touched[i];
+            unsigned char const bucket = sct_internal_fuzz_bucket(sct_internal_fuzz_map[edge]);
+
+            if ((seen[edge] & bucket) == 0) {
+                seen[edge] |= bucket;
+                features += 1;
+            }
+            sct_internal_fuzz_map[edge] = 0;
+        }
+        sct_internal_fuzz_touched_count = 0;
+
+        return features;
+    }
+
+    // Load the saved inputs of a fuzz target as the seeds of its corpus. An empty input is
+    // always the first seed.
+    static inline struct sct_internal_fuzz_input* sct_internal_fuzz_load(
+        char const* const directory,
+        size_t* const count
+    ) {
+        struct sct_internal_fuzz_input* inputs = calloc(1, sizeof(*inputs));
+        DIR* const dir = opendir(directory);
+        struct dirent const* entry;
+
+        if (inputs == NULL) {
+            PANICF("Failed to allocate the corpus\n");
+        }
+        *count = 1;
+
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            char path[4096 + 256];
+            struct sct_internal_fuzz_input input;
+
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+            input.data = sct_internal_fuzz_read(path, SCT_FUZZ_MAX_LENGTH, &input.size);
+            if (input.data == NULL) {
+                continue;
+            }
+
+            inputs = realloc(inputs, (*count + 1) * sizeof(*inputs));
+            if (inputs == NULL) {
+                PANICF("Failed to allocate the corpus\n");
+            }
+            inputs[(*count)++] = input;
+        }
+        if (dir != NULL) {
+            closedir(dir);
+        }
+
+        return inputs;
+    }
+
+    // The fuzz loop of the child: run every seed once, then mutate random corpus inputs
+    // until the time or the runs are used up. An input that covers new features is added
+    // to the corpus. Exits with 0 when done, the input is in `shared` if the child dies.
+    // The target gets a copy of the input in a block of its exact size, so that a sanitizer
+    // catches reads past the end that the fixed size of `shared` would hide.
+    SCT_INTERNAL_FUZZ_UNCOVERED static void sct_internal_fuzz_loop(
+        struct sct_internal_fuzzer const* const fuzzer,
+        struct sct_internal_fuzz_shared* const shared,
+        struct sct_internal_fuzz_options const* const options,
+        char const* const directory
+    ) {
+        unsigned long long const deadline = sct_internal_fuzz_now() + (unsigned long long) (options->time * 1e9);
+        unsigned long long state = options->seed != 0 ? options->seed : sct_internal_fuzz_now() | 1;
+        unsigned char* const seen = calloc(SCT_FUZZ_MAP_SIZE, 1);
+        size_t count, seed_count;
+        struct sct_internal_fuzz_input* corpus = sct_internal_fuzz_load(directory, &count);
+
+        if (seen == NULL) {
+            PANICF("Failed to allocate the coverage map\n");
+        }
+        seed_count = count;
+        sct_internal_fuzz_collect(seen);
+        memset(seen, 0, SCT_FUZZ_MAP_SIZE);
+
+        for (unsigned long long run = 0; options->runs == 0 || run < options->runs; run += 1) {
+            unsigned char* data;
+            unsigned features;
+
+            if (run % 1024 == 0 && sct_internal_fuzz_now() >= deadline) {
+                break;
+            }
+
+            if (run < seed_count) {
+                shared->size = corpus[run].size;
+                memcpy(shared->data, corpus[run].data, shared->size);
+            } else {
+                struct sct_internal_fuzz_input const* const input = &corpus[sct_internal_fuzz_random(&state) % count];
+                unsigned const mutations = 1 + sct_internal_fuzz_random(&state) % 4;
+                size_t size = input->size;
+
+                memcpy(shared->data, input->data, size);
+                for (unsigned i = 0; i < mutations; i += 1) {
+                    sct_internal_fuzz_mutate(shared->data, &size, corpus, count, &state);
+                }
+                shared->size = size;
+            }
+
+            data = malloc(shared->size);
+            if (data == NULL && shared->size > 0) {
+                PANICF("Failed to allocate an input of %zu bytes\n", shared->size);
+            }
+            memcpy(data, shared->data, shared->size);
+
+            sct_internal_fuzz_previous = 0;
+            if (fuzzer->function(data, shared->size) != 0) {
+                fflush(stdout);
+                fflush(stderr);
+                _exit(EXIT_FAILURE);
+            }
+            free(data);
+            __atomic_store_n(&shared->executions, run + 1, __ATOMIC_RELAXED);
+
+            features = sct_internal_fuzz_collect(seen);
+            if (features > 0 && run >= seed_count) {
+                struct sct_internal_fuzz_input input = {malloc(shared->size), shared->size};
+                struct sct_internal_fuzz_input* const grown = realloc(corpus, (count + 1) * sizeof(*corpus));
+
+                if ((input.data != NULL || input.size == 0) && grown != NULL) {
+                    memcpy(input.data, shared->data, shared->size);
+                    corpus = grown;
+                    corpus[count++] = input;
+                    __atomic_store_n(&shared->corpus, count, __ATOMIC_RELAXED);
+                } else {
+                    free(input.data);
+                    corpus = grown != NULL ? grown : corpus;
+                }
+            }
+            if (features > 0) {
+                __atomic_store_n(&shared->features, shared->features + features, __ATOMIC_RELAXED);
+            }
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+        _exit(EXIT_SUCCESS);
+    }
+
+    // Create the directory and its parents.
+    static inline void sct_internal_fuzz_mkdir(char const* const directory) {
+        char path[4096];
+
+        snprintf(path, sizeof(path), "%s", directory);
+        for (char* c = path + 1; *c != '\0'; c += 1) {
+            if (*c == '/') {
+                *c = '\0';
+                mkdir(path, 0777);
+                *c = '/';
+            }
+        }
+        mkdir(path, 0777);
+    }
+
+    // Save the input that was running when the child died, named after its FNV-1a hash.
+    static inline void sct_internal_fuzz_save(
+        struct sct_internal_fuzz_shared const* const shared,
+        char const* const directory,
+        char const* const kind,
+        char* const path,
+        size_t const capacity
+    ) {
+        unsigned long long hash = 0xCBF29CE484222325ULL;
+        FILE* file;
+
+        for (size_t i = 0; i < shared->size; i += 1) {
+            hash = (hash ^ shared->data[i]) * 0x100000001B3ULL;
+        }
+        snprintf(path, capacity, "%s/%s-%016llx", directory, kind, hash);
+
+        sct_internal_fuzz_mkdir(directory);
+        file = fopen(path, "wb");
+        if (file == NULL || fwrite(shared->data, 1, shared->size, file) != shared->size) {
+            PANICF("Failed to save the input to %s\n", path);
+        }
+        fclose(file);
+    }
+
+    // Fuzz one target in a child process and watch it. Returns 1 if an input crashed or hung.
+    static inline int sct_internal_fuzz_run(
+        struct sct_internal_fuzzer const* const fuzzer,
+        struct sct_internal_fuzz_options const* const options
+    ) {
+        struct sct_internal_fuzz_shared* const shared = mmap(
+            NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0
+        );
+        unsigned long long const start = sct_internal_fuzz_now();
+        unsigned long long progress = start, report = start, executions = 0;
+        char directory[4096];
+        char path[4096 + 64];
+        int status, timed_out = 0;
+        pid_t pid;
+
+        if (shared == MAP_FAILED) {
+            PANICF("Failed to map the shared input\n");
+        }
+        sct_internal_fuzz_directory(directory, sizeof(directory), options->corpus, fuzzer->description);
+
+        fflush(stdout);
+        fflush(stderr);
+        pid = fork();
+        if (pid == -1) {
+            PANICF("Failed to fork a fuzz target\n");
+        }
+        if (pid == 0) {
+            sct_internal_fuzz_loop(fuzzer, shared, options, directory);
+        }
+
+        // The child is alive as long as its execution count goes up.
+        while (waitpid(pid, &status, WNOHANG) == 0) {
+            unsigned long long const now = sct_internal_fuzz_now();
+            unsigned long long const current = __atomic_load_n(&shared->executions, __ATOMIC_RELAXED);
+
+            if (current != executions) {
+                executions = current;
+                progress = now;
+            } else if (!timed_out && options->timeout > 0 && now - progress > options->timeout * 1e9) {
+                kill(pid, SIGKILL);
+                timed_out = 1;
+            }
+
+            if (now - report >= 1000000000ULL) {
+                report = now;
+                printf(
+                    "\e[90m  #%llu %.0f exec/s, corpus %llu, features %llu\e[0m\n",
+                    current, current / ((now - start) / 1e9),
+                    __atomic_load_n(&shared->corpus, __ATOMIC_RELAXED),
+                    __atomic_load_n(&shared->features, __ATOMIC_RELAXED)
+                );
+                fflush(stdout);
+            }
+
+            nanosleep(&(struct timespec) {.tv_nsec = 10000000}, NULL);
+        }
+
+        executions = shared->executions;
+        if (!timed_out && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            printf(
+                "\e[32m[PASS]\e[0m %s (%s:%d) \e[90m%llu runs, %.0f exec/s, corpus %llu, features %llu\e[0m\n",
+                fuzzer->description, fuzzer->file, fuzzer->line,
+                executions, executions / ((sct_internal_fuzz_now() - start) / 1e9), shared->corpus, shared->features
+            );
+            munmap(shared, sizeof(*shared));
+            return 0;
+        }
 
-//
-//  GGC DIAGNOSTIC PRAGMAS
-//
+        sct_internal_fuzz_save(shared, directory, timed_out ? "timeout" : "crash", path, sizeof(path));
+        printf("\e[31m[FAIL]\e[0m %s (%s:%d) \e[90mafter %llu runs\e[0m\n", fuzzer->description, fuzzer->file, fuzzer->line, executions);
+        if (timed_out) {
+            printf("   Timed out after %.3f s\n", options->timeout);
+        } else {
+            printf(
+                "   %s %d\n",
+                WIFSIGNALED(status) ? "Crashed with signal" : "Exited with status",
+                WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status)
+            );
+        }
+        printf("   Saved the input of %zu bytes to %s\n", shared->size, path);
 
-#define GCC_DIAGNOSTIC_IGNORED(x) _Pragma(TO_STRING(GCC diagnostic ignored x))
-#define GCC_DIAGNOSTIC_WARNING(x) _Pragma(TO_STRING(GCC diagnostic warning x))
+        munmap(shared, sizeof(*shared));
+        return 1;
+    }
 
-//
-//  VA ARGS
-//
+    // Fuzz every selected target for --time=<seconds> or --runs=<count> inputs. Crashing and
+    // hanging inputs are saved to --corpus=<directory>, which is also where the seeds are
+    // read from, and --seed=<number> makes a run reproducible.
+    // The first compilation unit to get here runs the fuzz targets of all of them and exits.
+    __attribute__ ((constructor(65535)))
+    static void sct_internal_run_fuzzers(int const argc, char** const argv) {
+        unsigned const registered = __stop_sct_fuzzers - __start_sct_fuzzers;
+        struct sct_internal_fuzz_options options = {
+            .corpus = SCT_FUZZ_CORPUS,
+            .time = SCT_FUZZ_TIME,
+            .timeout = SCT_FUZZ_TIMEOUT,
+        };
+        unsigned count = 0, fail_count = 0;
+
+        if (registered == 0) {
+            return;
+        }
 
-#define ARGS_COUNT(args...)                         \
-    ({                                              \
-        GCC_DIAGNOSTIC_IGNORED("-Wint-conversion")  \
-        (sizeof((void*[]){args}) / sizeof(void*));  \
-        GCC_DIAGNOSTIC_WARNING("-Wint-conversion")  \
-    })
+        for (int i = 1; i < argc; i += 1) {
+            if (strncmp(argv[i], "--filter=", 9) == 0) {
+                options.filter = argv[i] + 9;
+            } else if (strncmp(argv[i], "--corpus=", 9) == 0) {
+                options.corpus = argv[i] + 9;
+            } else if (strncmp(argv[i], "--time=", 7) == 0) {
+                options.time = strtod(argv[i] + 7, NULL);
+            } else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+                options.timeout = strtod(argv[i] + 10, NULL);
+            } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+                options.runs = strtoull(argv[i] + 7, NULL, 10);
+            } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+                options.seed = strtoull(argv[i] + 7, NULL, 10);
+            }
+        }
 
-#define ARGS_GET(index, args...)                    \
-    ({                                              \
-        GCC_DIAGNOSTIC_IGNORED("-Wint-conversion")  \
-        (((void*[]){args})[(index)]);               \
-        GCC_DIAGNOSTIC_WARNING("-Wint-conversion")  \
-    })
+        for (unsigned i = 0; i < registered; i += 1) {
+            struct sct_internal_fuzzer const* const fuzzer = &__start_sct_fuzzers[i];
+            if (options.filter == NULL || fnmatch(options.filter, fuzzer->description, 0) == 0) {
+                fail_count += sct_internal_fuzz_run(fuzzer, &options);
+                count += 1;
+            }
+        }
 
-#define ARGS_HAS_INDEX(index, args...)          \
-    ({                                          \
-        GCC_DIAGNOSTIC_IGNORED("-Wtype-limits") \
-        (ARGS_COUNT(args) - 1 >= (index));      \
-        GCC_DIAGNOSTIC_WARNING("-Wtype-limits") \
-    })
+        printf(
+            "\n\e[34mTotal:\e[0m %u, \e[32mPass:\e[0m %u, \e[31mFail:\e[0m %u\n",
+            count, count - fail_count, fail_count
+        );
+        exit(fail_count > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
 
-#define ARGS_GET_OR_DEFAULT(index, default, args...)    \
-    ({                                                  \
-        GCC_DIAGNOSTIC_IGNORED("-Warray-bounds")        \
-        typeof(default) value = default;                \
-        if (ARGS_HAS_INDEX(index, args)) {              \
-            GCC_DIAGNOSTIC_IGNORED("-Wint-conversion")  \
-            value = ARGS_GET(index, args);              \
-            GCC_DIAGNOSTIC_WARNING("-Wint-conversion")  \
-        }                                               \
-        value;                                          \
-        GCC_DIAGNOSTIC_WARNING("-Warray-bounds")        \
-    })
+#elif defined(TESTS)
+
+    // Run every saved input of a fuzz target in a child process of its own, so one crash
+    // does not hide the others. The test fails if any input crashes, fails or runs for longer
+    // than SCT_FUZZ_TIMEOUT seconds, like the fuzzer saves it as a hang.
+    static inline int sct_internal_fuzz_replay(
+        char const* const description,
+        char const* const file,
+        int const line,
+        int (*const function)(unsigned char const* data, size_t size)
+    ) {
+        char directory[4096];
+        struct dirent const* entry;
+        DIR* dir;
+        int failed = 0;
+
+        sct_internal_fuzz_directory(directory, sizeof(directory), SCT_FUZZ_CORPUS, description);
+        dir = opendir(directory);
+        if (dir == NULL) {
+            return 0;
+        }
 
-//
-//  TRACEBACK
-//
+        while ((entry = readdir(dir)) != NULL) {
+            char path[4096 + 256];
+            unsigned long long start;
+            unsigned char* data;
+            size_t size;
+            int status, timed_out = 0;
+            pid_t pid, waited;
 
-#define SCT_INTERNAL_TRACEBACK_LEADING_TEXT     \
-    "Traceback (most recent call last):\n"
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+            data = sct_internal_fuzz_read(path, (size_t) -1, &size);
+            if (data == NULL) {
+                continue;
+            }
 
-#define SCT_INTERNAL_TRACEBACK_ERROR_FORMAT     \
-    "    File %s, line %d, in function %s\n"    \
-    "        %s %s"
+            fflush(stdout);
+            fflush(stderr);
+            pid = fork();
+            if (pid == 0) {
+                int const result = function(data, size);
+                fflush(stdout);
+                fflush(stderr);
+                _exit(result != 0);
+            }
+            free(data);
+
+            start = sct_internal_test_now();
+            waited = pid;
+            while (pid != -1 && ((waited = waitpid(pid, &status, WNOHANG)) == 0 || (waited == -1 && errno == EINTR))) {
+                if (!timed_out && SCT_FUZZ_TIMEOUT > 0 && sct_internal_test_now() - start > SCT_FUZZ_TIMEOUT * 1e9) {
+                    kill(pid, SIGKILL);
+                    timed_out = 1;
+                }
+                poll(NULL, 0, 1);
+            }
 
-#define SCT_INTERNAL_TRACEBACK_ERRORF_FORMAT    \
-    "    File %s, line %d, in function %s\n"    \
-    "        %s"
+            if (pid == -1 || waited == -1) {
+                dprintf(sct_internal_test_fd, "\e[31mFailed test:\e[0m %s (%s:%d)\n   Failed to run input %s\n", description, file, line, path);
+                failed = 1;
+            } else if (timed_out) {
+                dprintf(
+                    sct_internal_test_fd, "\e[31mFailed test:\e[0m %s (%s:%d)\n   Input %s timed out after %.3f s\n",
+                    description, file, line, path, (double) SCT_FUZZ_TIMEOUT
+                );
+                failed = 1;
+            } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                dprintf(
+                    sct_internal_test_fd, "\e[31mFailed test:\e[0m %s (%s:%d)\n   Input %s %s %d\n",
+                    description, file, line, path,
+                    WIFSIGNALED(status) ? "crashed with signal" : "exited with status",
+                    WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status)
+                );
+                failed = 1;
+            }
+        }
+        closedir(dir);
 
-#define SCT_INTERNAL_TRACEBACK_RESOLVE_FORMAT(evaluation)                       \
-    _Generic((evaluation),                                                      \
-        char: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %c\n",                   \
-        unsigned char: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %d\n",          \
-        int: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %d\n",                    \
-        long int: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %ld\n",              \
-        long long: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %lld\n",            \
-        unsigned: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %u\n",               \
-        unsigned long long: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %llu\n",   \
-        char*: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => \"%s\"\n",              \
-        default: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %p\n"                 \
-    )
+        return failed;
+    }
 
-#define SCT_INTERNAL_TRACEBACK_RESOLVE_FORMAT_WITH_ERROR(evaluation)                \
-    _Generic((evaluation),                                                          \
-        char: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %c -> %s\n",                 \
-        unsigned char: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %d -> %s\n",        \
-        int: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %d -> %s\n",                  \
-        long int: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %ld -> %s\n",            \
-        long long: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %lld -> %s\n",          \
-        unsigned: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %u -> %s\n",             \
-        unsigned long long: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %llu -> %s\n", \
-        char*: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => \"%s\" -> %s\n",            \
-        default: SCT_INTERNAL_TRACEBACK_ERROR_FORMAT " => %p -> %s\n"               \
-    )
+    // With -DTESTS, a fuzz target is a test that replays its saved inputs.
+    #define SCT_INTERNAL_FUZZ(description, data, size, body, id)                            \
+        SCT_INTERNAL_FUZZ_FUNCTION(description, data, size, body, id)                       \
+        TEST(description, {                                                                 \
+            return sct_internal_fuzz_replay(__desc, __FILE__, __LINE__, CONCAT(sct_fuzz_, id)); \
+        })
 
-//
-//  DEBUG MODE: Expand debugging capabilities with longer error messages
-//
+    #define FUZZ(description, data, size, body) SCT_INTERNAL_FUZZ(description, data, size, body, __COUNTER__)
 
-#ifdef DEBUG
+#else
 
-    //
-    //  TRACEBACK
-    //
+    #define FUZZ(description, data, size, body)
 
-    #define TRACE(expression)                                               \
-        ({                                                                  \
-            typeof(expression) evaluation = (expression);                   \
-            SCT_INTERNAL_TRACEBACK_PUSH("TRACE", expression, evaluation);   \
-            evaluation;                                                     \
-        })
+#endif
 
-    #define SCT_INTERNAL_TRACEBACK_COUNT_MAX 256
-    #define SCT_INTERNAL_TRACEBACK_LENGTH_MAX 256
+//
+//  GUARDED ALLOCATION: Place sampled allocations against guard pages (behind -DSCT_GUARDED_ALLOC)
+//
 
-    static int sct_internal_traceback_count __attribute__ ((unused)) = 0;
-    static char sct_internal_traceback[SCT_INTERNAL_TRACEBACK_COUNT_MAX][SCT_INTERNAL_TRACEBACK_LENGTH_MAX] __attribute__ ((unused));
+#ifdef SCT_GUARDED_ALLOC
+
+    #include <sched.h>
+    #include <signal.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+
+    // One in N allocations made with MALLOC or CALLOC is guarded, on average.
+    #ifndef SCT_GUARDED_ALLOC_SAMPLE_RATE
+        #define SCT_GUARDED_ALLOC_SAMPLE_RATE 1000
+    #endif
+
+    // Pages for guarded allocations. Pages are reused round-robin, so a freed page
+    // stays inaccessible until the other slots have been used.
+    #ifndef SCT_GUARDED_ALLOC_SLOTS
+        #define SCT_GUARDED_ALLOC_SLOTS 256
+    #endif
+
+    enum scti_guarded_state {
+        SCTI_GUARDED_STATE_FREE,
+        SCTI_GUARDED_STATE_LIVE,
+        SCTI_GUARDED_STATE_QUARANTINED,
+    };
+
+    struct scti_guarded_slot {
+        void* pointer;
+        size_t size;
+        unsigned allocation_site;
+        unsigned free_site;
+        int state;
+    };
+
+    // Slot i is the page at base + (2 * i + 1) * page_size, every slot is surrounded by guard pages.
+    struct scti_guarded_pool {
+        unsigned char* base;
+        size_t page_size;
+        size_t length;
+        unsigned next;
+        int lock;
+        struct sigaction previous;
+        struct scti_guarded_slot slots[SCT_GUARDED_ALLOC_SLOTS];
+    };
+
+    __attribute__ ((weak)) struct scti_guarded_pool scti_guarded;
+    __attribute__ ((weak)) unsigned long long scti_guarded_seed;
+    __attribute__ ((weak)) _Thread_local size_t scti_guarded_countdown;    // Zero until the first allocation of the thread.
+    __attribute__ ((weak)) _Thread_local unsigned long long scti_guarded_random;
+
+    // The MALLOC and FREE sites are placed in the scti_guarded_sites section, apart from the throw
+    // and crash sites of sct_sites, so that the site table and tools/sctstat.c list no allocation sites.
+    extern struct sct_internal_site const __start_scti_guarded_sites[] __attribute__ ((weak));
+    extern struct sct_internal_site const __stop_scti_guarded_sites[] __attribute__ ((weak));
+
+    static inline int scti_guarded_owns(void const* const pointer) {
+        return scti_guarded.base != NULL
+            && (size_t) ((unsigned char const*) pointer - scti_guarded.base) < scti_guarded.length;
+    }
 
-    #define SCT_INTERNAL_TRACEBACK_RESET sct_internal_traceback_count = 0;
+    // The number of allocations until the next guarded one, uniform in [1, 2 * SCT_GUARDED_ALLOC_SAMPLE_RATE].
+    static inline size_t scti_guarded_next_countdown(void) {
+        unsigned long long x = scti_guarded_random;
 
-    // TODO: Else crash? At least warn that the traceback count has been reached
-    #define SCT_INTENRAL_TRACEBACK_PUSH_FORMAT(format, args...)                         \
-        do {                                                                            \
-            if (sct_internal_traceback_count < SCT_INTERNAL_TRACEBACK_COUNT_MAX) {      \
-                snprintf(                                                               \
-                    (char*) &sct_internal_traceback[sct_internal_traceback_count++],    \
-                    SCT_INTERNAL_TRACEBACK_LENGTH_MAX,                                  \
-                    format,                                                             \
-                    ## args                                                             \
-                );                                                                      \
-            }                                                                           \
-        } while (0);
+        if (x == 0) {
+            x = (unsigned long long) (size_t) &scti_guarded_random
+                ^ __atomic_add_fetch(&scti_guarded_seed, 0x9e3779b97f4a7c15ULL, __ATOMIC_RELAXED);
+            x |= 1;
+        }
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        scti_guarded_random = x;
 
-    #define SCT_INTERNAL_TRACEBACK_PUSH(description, expression, evaluation)                        \
-        SCT_INTENRAL_TRACEBACK_PUSH_FORMAT(                                                         \
-            SCT_INTERNAL_TRACEBACK_RESOLVE_FORMAT(evaluation),                                      \
-            __FILE__, __LINE__, __PRETTY_FUNCTION__, description, TO_STRING(expression), evaluation \
-        )
+        return 1 + x % (2 * SCT_GUARDED_ALLOC_SAMPLE_RATE);
+    }
 
-    #define SCT_INTERNAL_TRACEBACK_PUSH_WITH_ERROR(description, expression, evaluation, error)                          \
-        SCT_INTENRAL_TRACEBACK_PUSH_FORMAT(                                                                             \
-            SCT_INTERNAL_TRACEBACK_RESOLVE_FORMAT_WITH_ERROR(evaluation),                                               \
-            __FILE__, __LINE__, __PRETTY_FUNCTION__, description, TO_STRING(expression), evaluation, TO_STRING(error)   \
-        )
+    // The fault report is formatted without stdio, which is not async-signal-safe.
+    struct scti_guarded_report {
+        char text[2048];
+        size_t length;
+    };
 
-    #define SCT_INTERNAL_TRACEBACK_PUSHF(description, format, args...)          \
-        SCT_INTENRAL_TRACEBACK_PUSH_FORMAT(                                     \
-            SCT_INTERNAL_TRACEBACK_ERRORF_FORMAT "\n        " format,           \
-            __FILE__, __LINE__, __PRETTY_FUNCTION__, description, ## args       \
-        )
+    static void scti_guarded_append(struct scti_guarded_report* const report, char const* string) {
+        if (string == NULL) {
+            string = "(null)";
+        }
+        for (; *string != '\0' && report->length < sizeof(report->text); string += 1) {
+            report->text[report->length++] = *string;
+        }
+    }
 
-    #define SCT_INTERNAL_TRACEBACK_PUSHF_WITH_ERROR(description, error, format, args...)    \
-        SCT_INTENRAL_TRACEBACK_PUSH_FORMAT(                                                 \
-            SCT_INTERNAL_TRACEBACK_ERRORF_FORMAT "-> %s\n        " format,                  \
-            __FILE__, __LINE__, __PRETTY_FUNCTION__, description, # error, ## args          \
-        )
+    static void scti_guarded_append_number(
+        struct scti_guarded_report* const report,
+        unsigned long long number,
+        unsigned const base
+    ) {
+        char digits[24];
+        size_t count = 0;
+
+        do {
+            digits[count++] = "0123456789abcdef"[number % base];
+            number /= base;
+        } while (number != 0);
+
+        if (base == 16) {
+            scti_guarded_append(report, "0x");
+        }
+        while (count > 0 && report->length < sizeof(report->text)) {
+            report->text[report->length++] = digits[--count];
+        }
+    }
 
-    #define SCT_INTERNAL_TRACEBACK_PRINT(description, expression, evaluation)   \
-        do {                                                                    \
-            fprintf(stderr, SCT_INTERNAL_TRACEBACK_LEADING_TEXT);               \
-            for (int i = 0; i < sct_internal_traceback_count; i += 1)           \
-                fprintf(stderr, "%s", sct_internal_traceback[i]);               \
-        } while (0);
+    static void scti_guarded_append_site(
+        struct scti_guarded_report* const report,
+        char const* const label,
+        unsigned const id
+    ) {
+        struct sct_internal_site const* const site = &__start_scti_guarded_sites[id];
+
+        scti_guarded_append(report, "    ");
+        scti_guarded_append(report, label);
+        scti_guarded_append(report, "\n    File ");
+        scti_guarded_append(report, site->file);
+        scti_guarded_append(report, ", line ");
+        scti_guarded_append_number(report, (unsigned long long) site->line, 10);
+        scti_guarded_append(report, ", in function ");
+        scti_guarded_append(report, site->function);
+        scti_guarded_append(report, "\n        ");
+        scti_guarded_append(report, site->description);
+        scti_guarded_append(report, " ");
+        scti_guarded_append(report, site->expression);
+        scti_guarded_append(report, "\n");
+    }
 
-    #define SCT_INTERNAL_TRACEBACK_PRINTF(description, format, args...) SCT_INTERNAL_TRACEBACK_PRINT(0, 0, 0)
+    static void scti_guarded_write(struct scti_guarded_report const* const report) {
+        for (size_t written = 0; written < report->length; ) {
+            ssize_t const result = write(STDERR_FILENO, report->text + written, report->length - written);
+            if (result <= 0) {
+                break;
+            }
+            written += (size_t) result;
+        }
+    }
 
-    //
-    //  INTERNAL MEMORY ALLOCATION
-    //
+    // Report a fault in the guarded pages and let the default action kill the process.
+    // Faults anywhere else are passed on to the previous handler.
+    static void scti_guarded_signal(int const signal_number, siginfo_t* const info, void* const context) {
+        struct scti_guarded_report report;
+        struct scti_guarded_slot const* slot;
+        size_t offset, page, index;
+        char const* kind;
+
+        if (!scti_guarded_owns(info->si_addr)) {
+            if (scti_guarded.previous.sa_flags & SA_SIGINFO) {
+                scti_guarded.previous.sa_sigaction(signal_number, info, context);
+                return;
+            }
+            sigaction(SIGSEGV, &scti_guarded.previous, NULL);
+            return;
+        }
 
-    // Must not be divisible by 8, sizeof(void*)
-    #define SCTI_ALLOC_SIZE 1019
-    #define SCTI_ALLOC_INFO_SIZE 64
-    #define SCTI_ALLOC_HASH(pointer) (((size_t)pointer) % SCTI_ALLOC_SIZE)
-
-    static void const* scti_alloc_pointers[SCTI_ALLOC_SIZE];
-    static size_t scti_alloc_counts[SCTI_ALLOC_SIZE];                           // element count
-    static size_t scti_alloc_sizes[SCTI_ALLOC_SIZE];                            // element size
-    static char scti_alloc_infos[SCTI_ALLOC_SIZE][SCTI_ALLOC_INFO_SIZE];
-    static size_t scti_alloc_count = 0;
-    static int scti_alloc_destruct = 1;
-
-    #define SCTI_ALLOC_SET_INDEX(pointer, count, size)      \
-        do {                                                \
-            size_t const hash = SCTI_ALLOC_HASH(pointer);   \
-            if (scti_alloc_pointers[hash] != 0) {           \
-                scti_alloc_destruct = 0;                    \
-                SCT_INTERNAL_CRASHF(                        \
-                    "ALLOC_SET_INDEX",                      \
-                    "Hash collision!\n"                     \
-                );                                          \
-            }                                               \
-            scti_alloc_pointers[hash] = pointer;            \
-            scti_alloc_counts[hash] = count;                \
-            scti_alloc_sizes[hash] = size;                  \
-            sprintf(                                        \
-                scti_alloc_infos[hash],                     \
-                "file %s, line %d, in function %s",         \
-                __FILE__, __LINE__, __PRETTY_FUNCTION__     \
-            );                                              \
-            scti_alloc_count += 1;                          \
-        } while (0);
+        offset = (unsigned char*) info->si_addr - scti_guarded.base;
+        page = offset / scti_guarded.page_size;
+        if (page % 2 == 1) {
+            index = page / 2;
+            kind = "use after free";
+        } else if (page == 0 || (page / 2 < SCT_GUARDED_ALLOC_SLOTS && offset % scti_guarded.page_size >= scti_guarded.page_size / 2)) {
+            index = page / 2;
+            kind = "buffer underflow";
+        } else {
+            index = page / 2 - 1;
+            kind = "buffer overflow";
+        }
+        slot = &scti_guarded.slots[index];
+
+        report.length = 0;
+        scti_guarded_append(&report, "\e[31m\nGuarded allocation fault: ");
+        scti_guarded_append(&report, kind);
+        scti_guarded_append(&report, " at ");
+        scti_guarded_append_number(&report, (unsigned long long) (size_t) info->si_addr, 16);
+        scti_guarded_append(&report, ", the allocation is ");
+        scti_guarded_append_number(&report, slot->size, 10);
+        scti_guarded_append(&report, " bytes at ");
+        scti_guarded_append_number(&report, (unsigned long long) (size_t) slot->pointer, 16);
+        scti_guarded_append(&report, "\n");
+        if (slot->state != SCTI_GUARDED_STATE_FREE) {
+            scti_guarded_append_site(&report, "Allocated in:", slot->allocation_site);
+        }
+        if (slot->state == SCTI_GUARDED_STATE_QUARANTINED) {
+            scti_guarded_append_site(&report, "Freed in:", slot->free_site);
+        }
+        scti_guarded_append(&report, "\e[0m");
 
-    #define SCTI_ALLOC_UNSET_INDEX(pointer)                             \
-        do {                                                            \
-            size_t const hash = SCTI_ALLOC_HASH(pointer);               \
-            if (scti_alloc_pointers[hash] == 0) {                       \
-                scti_alloc_destruct = 0;                                \
-                SCT_INTERNAL_CRASHF(                                    \
-                    "ALLOC_UNSET_INDEX",                                \
-                    "Hash not found!\n"                                 \
-                );                                                      \
-            }                                                           \
-            scti_alloc_pointers[hash] = 0;                              \
-            scti_alloc_counts[hash] = 0;                                \
-            scti_alloc_sizes[hash] = 0;                                 \
-            memset(scti_alloc_infos[hash], 0, SCTI_ALLOC_INFO_SIZE);    \
-            scti_alloc_count -= 1;                                      \
-        } while (0);
+        scti_guarded_write(&report);
 
-    #define SCTI_ALLOC_BOUNDS_CHECK(pointer, index)             \
-        do {                                                    \
-            size_t const hash = SCTI_ALLOC_HASH(pointer);       \
-            if (scti_alloc_pointers[hash] == 0) {               \
-                break;                                          \
-            }                                                   \
-            if (index >= scti_alloc_counts[hash]) {             \
-                scti_alloc_destruct = 0;                        \
-                SCT_INTERNAL_CRASHF(                            \
-                    "ALLOC_BOUNDS_CHECK",                       \
-                    "Index out of bounds: %llu > %llu\n",       \
-                    (size_t)index, scti_alloc_counts[hash] - 1  \
-                );                                              \
-            }                                                   \
-        } while (0);
+        sigaction(SIGSEGV, &(struct sigaction) {.sa_handler = SIG_DFL}, NULL);
+    }
 
-    __attribute__((destructor))
-    static inline void scti_check_for_leaks(void) {
-        void const* pointer;
-        size_t count, size;
-        char const* info;
+    __attribute__ ((constructor(101)))
+    static void scti_guarded_open(void) {
+        struct sigaction action = {.sa_sigaction = scti_guarded_signal, .sa_flags = SA_SIGINFO};
+        size_t const page_size = sysconf(_SC_PAGESIZE);
+        size_t const length = page_size * (2 * SCT_GUARDED_ALLOC_SLOTS + 1);
+        void* base;
+
+        if (scti_guarded.base != NULL) {
+            return;
+        }
 
-        if (!scti_alloc_destruct || scti_alloc_count == 0) {
+        base = mmap(NULL, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            ERRORF("Failed to map %zu bytes for guarded allocations\n", length);
             return;
         }
 
-        fprintf(stderr, "\e[31m\nMemory leaks:\n");
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &scti_guarded.previous);
 
-        for (int i = 0; i < SCTI_ALLOC_SIZE; i += 1) {
-            pointer = scti_alloc_pointers[i];
+        scti_guarded.page_size = page_size;
+        scti_guarded.length = length;
+        __atomic_store_n(&scti_guarded.base, base, __ATOMIC_RELEASE);
+    }
 
-            if (pointer != 0) {
-                count = scti_alloc_counts[i];
-                size = scti_alloc_sizes[i];
-                info = scti_alloc_infos[i];
-                fprintf(stderr, "  %10llu bytes allocated in %s\n", count * size, info);
+    static inline void scti_guarded_lock(void) {
+        for (int spins = 0; __atomic_exchange_n(&scti_guarded.lock, 1, __ATOMIC_ACQUIRE); spins += 1) {
+            if (spins >= 100) {
+                sched_yield();
             }
         }
     }
 
-#else
+    static inline void scti_guarded_unlock(void) {
+        __atomic_store_n(&scti_guarded.lock, 0, __ATOMIC_RELEASE);
+    }
 
-    //
-    //  TRACEBACK
-    //
+    // Place the allocation at the end of a slot page, as close to the next guard page as the
+    // alignment allows, or at the start of it to catch underflows instead. The side is random.
+    // Returns NULL if the allocation can not be guarded.
+    static inline void* scti_guarded_take(size_t const size, size_t const align, unsigned const site) {
+        struct scti_guarded_slot* slot = NULL;
+        unsigned char* page;
 
-    #define TRACE(expression) expression
-    #define SCT_INTERNAL_TRACEBACK_RESET
-    #define SCT_INTERNAL_TRACEBACK_PUSH(description, expression, evaluation)
-    #define SCT_INTERNAL_TRACEBACK_PUSH_WITH_ERROR(description, expression, evaluation, error)
-    #define SCT_INTERNAL_TRACEBACK_PUSHF(description, format, args...)
-    #define SCT_INTERNAL_TRACEBACK_PUSHF_WITH_ERROR(description, error, format, args...)
-
-    #define SCT_INTERNAL_TRACEBACK_PRINT(description, expression, evaluation)                               \
-        do {                                                                                                \
-            fprintf(stderr, SCT_INTERNAL_TRACEBACK_LEADING_TEXT);                                           \
-            fprintf(                                                                                        \
-                stderr,                                                                                     \
-                SCT_INTERNAL_TRACEBACK_RESOLVE_FORMAT(evaluation),                                          \
-                __FILE__, __LINE__, __PRETTY_FUNCTION__, description, TO_STRING(expression), evaluation     \
-            );                                                                                              \
-        } while (0);
+        if (scti_guarded.base == NULL || size == 0 || size > scti_guarded.page_size) {
+            return NULL;
+        }
 
-    #define SCT_INTERNAL_TRACEBACK_PRINTF(description, format, args...) \
-        do {                                                            \
-            fprintf(stderr, SCT_INTERNAL_TRACEBACK_LEADING_TEXT);       \
-            fprintf(                                                    \
-                stderr,                                                 \
-                SCT_INTERNAL_TRACEBACK_ERRORF_FORMAT "\n"               \
-                "        "                                              \
-                format,                                                 \
-                __FILE__, __LINE__, __PRETTY_FUNCTION__, description,   \
-                ## args                                                 \
-            );                                                          \
-        } while (0);
+        scti_guarded_lock();
+        for (unsigned i = 0; i < SCT_GUARDED_ALLOC_SLOTS; i += 1) {
+            unsigned const index = (scti_guarded.next + i) % SCT_GUARDED_ALLOC_SLOTS;
+            if (scti_guarded.slots[index].state != SCTI_GUARDED_STATE_LIVE) {
+                slot = &scti_guarded.slots[index];
+                scti_guarded.next = index + 1;
+                break;
+            }
+        }
+        if (slot != NULL) {
+            slot->state = SCTI_GUARDED_STATE_LIVE;
+        }
+        scti_guarded_unlock();
 
-    //
-    //  INTERNAL MEMORY ALLOCATION
-    //
+        if (slot == NULL) {
+            return NULL;
+        }
 
-    #define SCTI_ALLOC_SET_INDEX(pointer, count, size)
-    #define SCTI_ALLOC_UNSET_INDEX(pointer)
-    #define SCTI_ALLOC_BOUNDS_CHECK(pointer, index)
+        page = scti_guarded.base + (2 * (slot - scti_guarded.slots) + 1) * scti_guarded.page_size;
+        if (mprotect(page, scti_guarded.page_size, PROT_READ | PROT_WRITE) != 0) {
+            __atomic_store_n(&slot->state, SCTI_GUARDED_STATE_FREE, __ATOMIC_RELEASE);
+            return NULL;
+        }
 
-#endif
+        slot->pointer = scti_guarded_random >> 63
+            ? (void*) page
+            : (void*) ((size_t) (page + scti_guarded.page_size - size) & ~(align - 1));
+        slot->size = size;
+        slot->allocation_site = site;
+        return slot->pointer;
+    }
 
-//
-//  TESTING MODE: Run tests defined in the source files
-//
+    // Returns a guarded allocation, or NULL when the allocation is not sampled or no slot is free,
+    // in which case the caller falls back to the system allocator.
+    static void* scti_guarded_sample(size_t const size, size_t const align, unsigned const site) {
+        int const first = scti_guarded_countdown == 0;
 
-#ifdef TESTS
+        scti_guarded_countdown = scti_guarded_next_countdown();
+        return first ? NULL : scti_guarded_take(size, align, site);
+    }
 
-    #define SCT_INTERNAL_TEST_MESSAGES_COUNT_MAX 1024
-    #define SCT_INTERNAL_TEST_MESSAGES_LENGTH_MAX 256
+    static inline void* scti_guarded_malloc(size_t const size, size_t const align, unsigned const site) {
+        void* pointer;
 
-    static char sct_internal_test_messages[SCT_INTERNAL_TEST_MESSAGES_COUNT_MAX][SCT_INTERNAL_TEST_MESSAGES_LENGTH_MAX] __attribute__ ((unused));
-    static unsigned sct_internal_test_count __attribute__ ((unused)) = 0;
-    static unsigned sct_internal_test_fail_count __attribute__ ((unused)) = 0;
+        if (__builtin_expect(scti_guarded_countdown > 1, 1)) {
+            scti_guarded_countdown -= 1;
+            return malloc(size);
+        }
+        pointer = scti_guarded_sample(size, align, site);
+        return pointer != NULL ? pointer : malloc(size);
+    }
 
-    #define ASSERT_EQUAL(a, b)                                                          \
-        do {                                                                            \
-            typeof(a) evaluated = a;                                                    \
-            if (!IS_EQUAL(evaluated, b)) {                                              \
-                SCT_INTERNAL_TEST_MESSAGES_PUSH(__FILE__, __LINE__, a, b, evaluated);   \
-                return 1;                                                               \
-            }                                                                           \
-        } while (0)
+    static inline void* scti_guarded_calloc(size_t const count, size_t const size, size_t const align, unsigned const site) {
+        size_t total;
+        void* pointer;
 
-    #define ASSERT_NOT_EQUAL(a, b)                                  \
-        do {                                                        \
-            typeof(a) evaluated = a;                                \
-            if (IS_EQUAL(evaluated, b)) {                           \
-                SCT_INTERNAL_TEST_MESSAGES_PUSH(a, b, evaluated);   \
-                return 1;                                           \
-            }                                                       \
-        } while (0)
+        if (__builtin_expect(scti_guarded_countdown > 1, 1) || __builtin_mul_overflow(count, size, &total)) {
+            scti_guarded_countdown -= scti_guarded_countdown > 1;
+            return calloc(count, size);
+        }
 
-    #define ASSERT_NONE(expr) ASSERT_EQUAL(expr, 0)
-    #define ASSERT_SOME(expr) ASSERT_NOT_EQUAL(expr, 0)
+        pointer = scti_guarded_sample(total, align, site);
+        if (pointer == NULL) {
+            return calloc(count, size);
+        }
+        return memset(pointer, 0, total);
+    }
 
-    #define SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "\e[31mFailed test:\e[0m %s (%s:%d)\n   \e[33mExpected:\e[0m %s = %s\n   \e[33mReceived:\e[0m %s = "
+    // Freeing a guarded allocation twice, or a pointer into the middle of one, is reported and aborts.
+    static void scti_guarded_release(void* const pointer, unsigned const site) {
+        size_t const page = ((unsigned char*) pointer - scti_guarded.base) / scti_guarded.page_size;
+        struct scti_guarded_slot* const slot = &scti_guarded.slots[page / 2];
+
+        if (page % 2 == 0 || slot->state != SCTI_GUARDED_STATE_LIVE || slot->pointer != pointer) {
+            struct scti_guarded_report report = {.length = 0};
+            scti_guarded_append(&report, "\e[31m\nGuarded allocation fault: invalid or double free of ");
+            scti_guarded_append_number(&report, (unsigned long long) (size_t) pointer, 16);
+            scti_guarded_append(&report, "\n");
+            scti_guarded_append_site(&report, "Freed in:", site);
+            if (slot->state == SCTI_GUARDED_STATE_QUARANTINED) {
+                scti_guarded_append_site(&report, "Previously freed in:", slot->free_site);
+            }
+            scti_guarded_append(&report, "\e[0m");
+            scti_guarded_write(&report);
+            abort();
+        }
 
-    #define SCT_INTERNAL_RESOLVE_TEST_FAILURE_FORMAT(x)                             \
-        _Generic(x,                                                                 \
-            char: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%c\n",                     \
-            unsigned char: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%d\n",            \
-            int: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%d\n",                      \
-            long int: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%ld\n",                \
-            long long: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%lld\n",              \
-            unsigned: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%u\n",                 \
-            unsigned long long: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "%llu\n",     \
-            char*: SCT_INTERNAL_TEST_FAILURE_BASE_FORMAT "\"%s\"\n"                 \
-        )
+        mprotect((unsigned char*) scti_guarded.base + page * scti_guarded.page_size, scti_guarded.page_size, PROT_NONE);
+        slot->free_site = site;
+        __atomic_store_n(&slot->state, SCTI_GUARDED_STATE_QUARANTINED, __ATOMIC_RELEASE);
+    }
 
-    #define SCT_INTERNAL_TEST_MESSAGES_PUSH(expr, value, eval)                                          \
-        if (sct_internal_test_fail_count < SCT_INTERNAL_TEST_MESSAGES_COUNT_MAX) {                      \
-            snprintf(                                                                                   \
-                (char*) &sct_internal_test_messages[sct_internal_test_fail_count++],                    \
-                SCT_INTERNAL_TEST_MESSAGES_LENGTH_MAX,                                                  \
-                SCT_INTERNAL_RESOLVE_TEST_FAILURE_FORMAT(eval),                                         \
-                __desc, __FILE__, __LINE__, TO_STRING(expr), TO_STRING(value), TO_STRING(expr), eval    \
-            );                                                                                          \
+    static inline void scti_guarded_free(void* const pointer, unsigned const site) {
+        if (__builtin_expect(scti_guarded_owns(pointer), 0)) {
+            scti_guarded_release(pointer, site);
+            return;
         }
+        free(pointer);
+    }
 
-    #define TEST(description, body)                                                         \
-        __attribute__((constructor(200 + __COUNTER__))) void UNIQUE_NAME(sct_test_)(void) { \
-            const char *__desc __attribute__ ((unused)) = description;                      \
-            sct_internal_test_count += 1;                                                   \
-            int run_test(void) {                                                            \
-                body;                                                                       \
-                return 0;                                                                   \
-            }                                                                               \
-            int error = run_test();                                                         \
-            char *status = "PASS", *color = "\e[32m";                                       \
-            if (error) {                                                                    \
-                status = "FAIL";                                                            \
-                color = "\e[31m";                                                           \
-            }                                                                               \
-            printf(                                                                         \
-                "%s[%s]\e[0m %s (%s:%d)\n",                                                 \
-                color, status, description, __FILE__, __LINE__                              \
-            );                                                                              \
-        }
+    static inline void* scti_guarded_realloc(void* const pointer, size_t const size, size_t const align, unsigned const site) {
+        struct scti_guarded_slot const* slot;
+        void* new_pointer;
 
-    // TODO: If used in more than one compilation units, this function will run multiple times
-    static __attribute__ ((constructor(65535))) void sct_internal_run_after_tests(void) {
-        if (sct_internal_test_count == 0) {
-            return;
+        if (__builtin_expect(!scti_guarded_owns(pointer), 1)) {
+            return realloc(pointer, size);
         }
-        unsigned test_pass_count = sct_internal_test_count - sct_internal_test_fail_count;
-        for (unsigned i = 0; i < sct_internal_test_fail_count; i += 1) {
-            printf("\n%s", sct_internal_test_messages[i]);
+
+        slot = &scti_guarded.slots[((unsigned char*) pointer - scti_guarded.base) / scti_guarded.page_size / 2];
+        new_pointer = scti_guarded_malloc(size, align, site);
+        if (new_pointer == NULL && size > 0) {
+            return NULL;
         }
-        printf(
-            "\n\e[34mTotal:\e[0m %u, \e[32mPass:\e[0m %u, \e[31mFail:\e[0m %u\n",
-            sct_internal_test_count, test_pass_count, sct_internal_test_fail_count
-        );
-        exit(sct_internal_test_fail_count > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+        memcpy(new_pointer, pointer, slot->size < size ? slot->size : size);
+        scti_guarded_release(pointer, site);
+        return new_pointer;
     }
 
+    #define SCTI_GUARDED_SITE(description, expression)                                          \
+        ({                                                                                      \
+            static struct sct_internal_site const scti_guarded_site                             \
+                __attribute__ ((section("scti_guarded_sites"), used, aligned(8))) = {           \
+                    __FILE__, __PRETTY_FUNCTION__, description, expression, NULL, __LINE__      \
+                };                                                                              \
+            (unsigned) (&scti_guarded_site - __start_scti_guarded_sites);                       \
+        })
+    #define SCTI_GUARDED_MALLOC(count, type, site) scti_guarded_malloc(sizeof(type) * (count), _Alignof(type), site)
+    #define SCTI_GUARDED_CALLOC(count, type, site) scti_guarded_calloc(count, sizeof(type), _Alignof(type), site)
+    #define SCTI_GUARDED_REALLOC(pointer, count, type, site) \
+        scti_guarded_realloc(pointer, sizeof(type) * (count), _Alignof(type), site)
+    #define SCTI_GUARDED_FREE(pointer, site) scti_guarded_free(pointer, site)
+
 #else
 
-    #define TEST(description, body)
-    #define ASSERT_EQUAL(a, b) CRASH_IF((a) != (b))
-    #define ASSERT_NOT_EQUAL(a, b) CRASH_IF((a) == (b))
-    #define ASSERT_NONE(error) CRASH_IF((error) != 0)
-    #define ASSERT_SOME(error) CRASH_IF((error) == 0)
+    #define SCTI_GUARDED_SITE(description, expression) 0
+    #define SCTI_GUARDED_MALLOC(count, type, site) malloc(sizeof(type) * (count))
+    #define SCTI_GUARDED_CALLOC(count, type, site) calloc(count, sizeof(type))
+    #define SCTI_GUARDED_REALLOC(pointer, count, type, site) realloc(pointer, sizeof(type) * (count))
+    #define SCTI_GUARDED_FREE(pointer, site) free(pointer)
 
 #endif
 
@@ -456,32 +3808,38 @@
 //  MEMORY ALLOCATION
 //
 
-#define MALLOC(count, type)                                     \
-    ({                                                          \
-        void* const pointer = malloc(sizeof(type) * (count));   \
-        SCTI_ALLOC_SET_INDEX(pointer, count, sizeof(type))      \
-        pointer;                                                \
+#define MALLOC(count, type)                                                                 \
+    ({                                                                                      \
+        void* const pointer = SCTI_GUARDED_MALLOC(                                          \
+            count, type, SCTI_GUARDED_SITE("MALLOC", TO_STRING(count) ", " TO_STRING(type)) \
+        );                                                                                  \
+        SCTI_ALLOC_SET_INDEX(pointer, count, sizeof(type))                                  \
+        pointer;                                                                            \
     })
 
-#define CALLOC(count, type)                                 \
-    ({                                                      \
-        void* const pointer = calloc(count, sizeof(type));  \
-        SCTI_ALLOC_SET_INDEX(pointer, count, sizeof(type))  \
-        pointer;                                            \
+#define CALLOC(count, type)                                                                 \
+    ({                                                                                      \
+        void* const pointer = SCTI_GUARDED_CALLOC(                                          \
+            count, type, SCTI_GUARDED_SITE("CALLOC", TO_STRING(count) ", " TO_STRING(type)) \
+        );                                                                                  \
+        SCTI_ALLOC_SET_INDEX(pointer, count, sizeof(type))                                  \
+        pointer;                                                                            \
     })
 
-#define REALLOC(pointer, count, type)                                       \
-    ({                                                                      \
-        SCTI_ALLOC_UNSET_INDEX(pointer)                                     \
-        void* const new_pointer = realloc(pointer, sizeof(type) * (count)); \
-        SCTI_ALLOC_SET_INDEX(new_pointer, count, sizeof(type))              \
-        new_pointer;                                                        \
+#define REALLOC(pointer, count, type)                                                                \
+    ({                                                                                              \
+        SCTI_ALLOC_UNSET_INDEX(pointer)                                                             \
+        void* const new_pointer = SCTI_GUARDED_REALLOC(                                             \
+            pointer, count, type, SCTI_GUARDED_SITE("REALLOC", TO_STRING(count) ", " TO_STRING(type)) \
+        );                                                                                          \
+        SCTI_ALLOC_SET_INDEX(new_pointer, count, sizeof(type))                                      \
+        new_pointer;                                                                                \
     })
 
-#define FREE(pointer)                       \
-    do {                                    \
-        SCTI_ALLOC_UNSET_INDEX(pointer)     \
-        free(pointer);                      \
+#define FREE(pointer)                                                               \
+    do {                                                                            \
+        SCTI_ALLOC_UNSET_INDEX(pointer)                                             \
+        SCTI_GUARDED_FREE(pointer, SCTI_GUARDED_SITE("FREE", TO_STRING(pointer)));  \
     } while (0)
 
 #define DEREF(pointer, index)                       \
@@ -490,6 +3848,83 @@
         (pointer) + (index);                        \
     })
 
+//
+//  SPAN: A pointer that carries its element count, so indexing is checked with one inline compare
+//
+
+// The type of a span of `type` elements. Every Span(type) is a distinct struct type,
+// so typedef it to pass spans around: typedef Span(int) IntSpan;
+// Spans over existing memory can be initialized directly: Span(int) s = {array, 10};
+#define Span(type) struct { type* pointer; size_t count; }
+
+// Allocate `length` elements into `span`. Evaluates to the pointer, which is NULL on failure
+// (the count is zero then).
+#define SPAN_MALLOC(span, length)                                              \
+    ({                                                                          \
+        size_t const scti_span_count = (length);                                \
+        (span).pointer = MALLOC(scti_span_count, typeof(*(span).pointer));      \
+        (span).count = (span).pointer != NULL ? scti_span_count : 0;            \
+        (span).pointer;                                                         \
+    })
+
+#define SPAN_CALLOC(span, length)                                              \
+    ({                                                                          \
+        size_t const scti_span_count = (length);                                \
+        (span).pointer = CALLOC(scti_span_count, typeof(*(span).pointer));      \
+        (span).count = (span).pointer != NULL ? scti_span_count : 0;            \
+        (span).pointer;                                                         \
+    })
+
+#define SPAN_FREE(span)                 \
+    do {                                \
+        FREE((span).pointer);           \
+        (span).pointer = NULL;          \
+        (span).count = 0;               \
+    } while (0)
+
+// The element at `index`, crashes if the index is out of bounds. The check is a single
+// compare against the count, which the compiler can hoist out of loops.
+#define SPAN_AT(span, index)                                                                \
+    (*({                                                                                    \
+        typeof(span) const scti_span = (span);                                              \
+        size_t const scti_span_index = (index);                                             \
+        if (__builtin_expect(scti_span_index >= scti_span.count, 0)) {                      \
+            SCT_INTERNAL_CRASHF(                                                            \
+                "SPAN_AT", "Index %zu is out of bounds for a span of %zu elements\n",       \
+                scti_span_index, scti_span.count                                            \
+            );                                                                              \
+        }                                                                                   \
+        scti_span.pointer + scti_span_index;                                                \
+    }))
+
+// A span of `length` elements starting at `offset`, checked once when it is taken.
+#define SPAN_SLICE(span, offset, length)                                                    \
+    ({                                                                                      \
+        typeof(span) const scti_span = (span);                                              \
+        size_t const scti_span_offset = (offset);                                           \
+        size_t const scti_span_count = (length);                                            \
+        if (__builtin_expect(                                                               \
+            scti_span_offset > scti_span.count                                              \
+            || scti_span_count > scti_span.count - scti_span_offset, 0                      \
+        )) {                                                                                \
+            SCT_INTERNAL_CRASHF(                                                            \
+                "SPAN_SLICE", "Slice [%zu, %zu + %zu) is out of bounds for a span of %zu elements\n", \
+                scti_span_offset, scti_span_offset, scti_span_count, scti_span.count        \
+            );                                                                              \
+        }                                                                                   \
+        (typeof(span)) {scti_span.pointer + scti_span_offset, scti_span_count};             \
+    })
+
+// Iterate `element` over pointers to the elements of the span. The bounds are read
+// once before the loop, so the body needs no checks.
+#define SPAN_FOR(span, element)                                                 \
+    for (                                                                       \
+        typeof((span).pointer) element = (span).pointer,                        \
+            CONCAT(scti_span_end_, element) = element + (span).count;           \
+        element < CONCAT(scti_span_end_, element);                              \
+        element += 1                                                            \
+    )
+
 //
 //  THROW
 //
@@ -569,6 +4004,7 @@
 #define SCT_INTERNAL_CRASH(description, expression, evaluation)             \
     do {                                                                    \
         SCT_INTERNAL_TRACEBACK_PUSH(description, expression, evaluation)    \
+        SCT_INTERNAL_FLIGHT_CRASH                                           \
         SCT_INTERNAL_TRACEBACK_PRINT(description, expression, evaluation)   \
         exit(1);                                                            \
     } while (0)
@@ -604,6 +4040,7 @@
 #define SCT_INTERNAL_CRASHF(description, format, args...)           \
     do {                                                            \
         SCT_INTERNAL_TRACEBACK_PUSHF(description, format, ## args)  \
+        SCT_INTERNAL_FLIGHT_CRASH                                   \
         SCT_INTERNAL_TRACEBACK_PRINTF(description, format, ## args) \
         exit(1);                                                    \
     } while (0)
@@ -632,7 +4069,13 @@
 
 // Defer running statements until the end of the current scope if the condition is truthy.
 // If there are multiple defers in the same scope, they will be called in reverse order.
-#define DEFER_IF(condition, statement) SCT_INTERNAL_DEFER(condition, statement, UNIQUE_NAME(cleanup_var),  UNIQUE_NAME(cleanup_func))
+#define DEFER_IF(condition, statement)                                                          \
+    SCT_INTERNAL_DEFER(                                                                         \
+        condition,                                                                              \
+        SCT_INTERNAL_SITE_COUNT_ONLY("DEFER_IF", TO_STRING(condition)) statement,               \
+        UNIQUE_NAME(cleanup_var),                                                               \
+        UNIQUE_NAME(cleanup_func)                                                               \
+    )
 
 // Defer running statements until the end of the current scope.
 // If there are multiple defers in the same scope, they will be called in reverse order.
@@ -0,0 +1,106 @@
+// Render the records of a flight recorder file (see SCT_FLIGHT_RECORDER in safetyct.h)
+// as tracebacks, oldest first.
+//
+// Usage: sct_flight_decode [file]
+
+#include "../safetyct.h"
+
+#include <time.h>
+
+static int compare_records(void const* a, void const* b) {
+    unsigned long long const x = ((struct sct_internal_flight_record const*) a)->sequence;
+    unsigned long long const y = ((struct sct_internal_flight_record const*) b)->sequence;
+    return (x > y) - (x < y);
+}
+
+static void print_record(struct sct_internal_flight_record const* const record) {
+    struct sct_internal_traceback_frame frame = {
+        .file = record->file,
+        .function = record->function,
+        .description = record->description,
+        .expression = record->expression,
+        .error = record->error[0] != '\0' ? record->error : NULL,
+        .line = record->line,
+        .tag = record->tag,
+    };
+
+    frame.value.ull = record->value.ull;
+
+    if (frame.tag == SCT_INTERNAL_TRACEBACK_TAG_MESSAGE) {
+        frame.value.s = record->expression;
+    } else if (frame.tag == SCT_INTERNAL_TRACEBACK_TAG_STRING) {
+        sct_internal_traceback_copy_string(&frame, record->expression + sizeof(record->expression) / 2);
+    }
+
+    sct_internal_traceback_print_frame(stdout, &frame);
+}
+
+static void print_block_header(struct sct_internal_flight_record const* const record) {
+    time_t const seconds = record->time / 1000000000;
+    struct tm const* const local = localtime(&seconds);
+    char date[32] = {0};
+
+    // Timestamps that cannot be converted are printed as raw seconds since the epoch.
+    if (local == NULL || strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", local) == 0) {
+        snprintf(date, sizeof(date), "%lld", (long long) seconds);
+    }
+    printf(
+        "\n[pid %d, thread %d] %s.%09lld\n" SCT_INTERNAL_TRACEBACK_LEADING_TEXT,
+        record->pid, record->tid, date, record->time % 1000000000
+    );
+}
+
+int main(int argc, char **argv) {
+    char const* const path = argc > 1 ? argv[1] : SCT_FLIGHT_RECORDER_PATH;
+    struct sct_internal_flight_header header;
+    struct sct_internal_flight_record* records;
+    struct sct_internal_flight_record const* previous = NULL;
+    size_t count = 0;
+
+    FILE* file = fopen(path, "rb");
+    CRASHF_IF(file == NULL, "Failed to open %s\n", path);
+    DEFER(fclose(file));
+
+    CRASHF_IF(fread(&header, sizeof(header), 1, file) != 1, "Failed to read the header of %s\n", path);
+    CRASHF_IF(
+        memcmp(header.magic, SCT_INTERNAL_FLIGHT_MAGIC, sizeof(header.magic)) != 0,
+        "%s is not a flight recorder file\n", path
+    );
+    CRASHF_IF(
+        header.record_size != sizeof(struct sct_internal_flight_record),
+        "Unsupported record size %u\n", header.record_size
+    );
+
+    records = MALLOC(header.capacity, struct sct_internal_flight_record);
+    CRASHF_IF(records == NULL, "Failed to allocate %u records\n", header.capacity);
+    DEFER(FREE(records));
+
+    for (unsigned i = 0; i < header.capacity; i += 1) {
+        if (fread(&records[count], sizeof(*records), 1, file) != 1) {
+            break;
+        }
+        // Records that were being written when the process died have no sequence number.
+        if (records[count].sequence != 0) {
+            count += 1;
+        }
+    }
+
+    qsort(records, count, sizeof(*records), compare_records);
+
+    for (size_t i = 0; i < count; i += 1) {
+        struct sct_internal_flight_record const* const record = &records[i];
+
+        if (previous == NULL
+            || previous->kind == SCT_INTERNAL_FLIGHT_KIND_CRASH
+            || previous->pid != record->pid
+            || previous->tid != record->tid
+        ) {
+            print_block_header(record);
+        }
+
+        print_record(record);
+        previous = record;
+    }
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Print how often each site of a running process fired (see SCT_SITE_COUNTERS in safetyct.h).
+// With an interval, the number of hits per second is printed every interval instead.
+//
+// Usage: sctstat <pid> [interval in seconds]
+
+#include "../safetyct.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct row {
+    struct sct_internal_counter const* counter;
+    unsigned long long hits;
+};
+
+static int compare_rows(void const* a, void const* b) {
+    unsigned long long const x = ((struct row const*) a)->hits;
+    unsigned long long const y = ((struct row const*) b)->hits;
+    return (x < y) - (x > y);
+}
+
+static void print_rows(struct row* const rows, unsigned const count, char const* const unit) {
+    qsort(rows, count, sizeof(*rows), compare_rows);
+
+    printf("%12s  %-40s  %s\n", unit, "SITE", "EXPRESSION");
+
+    for (unsigned i = 0; i < count && rows[i].hits > 0; i += 1) {
+        struct sct_internal_counter const* const counter = rows[i].counter;
+        char location[160];
+
+        snprintf(location, sizeof(location), "%s:%lld %s", counter->file, counter->line, counter->function);
+        printf("%12llu  %-40s  %s %s", rows[i].hits, location, counter->description, counter->expression);
+        if (counter->error[0] != '\0') {
+            printf(" -> %s", counter->error);
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv) {
+    struct sct_internal_counters_header const* header;
+    struct sct_internal_counter const* counters;
+    unsigned long long* previous;
+    struct row* rows;
+    struct stat info;
+    char name[32];
+    int interval;
+    int fd;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <pid> [interval in seconds]\n", argv[0]);
+        return 1;
+    }
+
+    interval = argc > 2 ? atoi(argv[2]) : 0;
+    snprintf(name, sizeof(name), "/sct.%s", argv[1]);
+
+    fd = shm_open(name, O_RDONLY, 0);
+    CRASHF_IF(fd == -1, "Failed to open shared memory %s, is the process built with -DSCT_SITE_COUNTERS?\n", name);
+    CRASHF_IF(fstat(fd, &info) == -1, "Failed to stat shared memory %s\n", name);
+    CRASHF_IF((size_t) info.st_size < sizeof(*header), "Shared memory %s is too small\n", name);
+
+    header = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    CRASHF_IF(header == MAP_FAILED, "Failed to map shared memory %s\n", name);
+    CRASHF_IF(
+        memcmp(header->magic, SCT_INTERNAL_COUNTERS_MAGIC, sizeof(header->magic)) != 0,
+        "Shared memory %s is not initialized\n", name
+    );
+
+    counters = (struct sct_internal_counter const*) (header + 1);
+
+    rows = MALLOC(header->count, struct row);
+    previous = CALLOC(header->count, unsigned long long);
+    CRASHF_IF(rows == NULL || previous == NULL, "Failed to allocate %u rows\n", header->count);
+    DEFER(FREE(rows));
+    DEFER(FREE(previous));
+
+    for (unsigned i = 0; i < header->count; i += 1) {
+        rows[i].counter = &counters[i];
+        rows[i].hits = __atomic_load_n(&counters[i].count, __ATOMIC_RELAXED);
+    }
+
+    if (interval <= 0) {
+        print_rows(rows, header->count, "HITS");
+        return 0;
+    }
+
+    for (;;) {
+        for (unsigned i = 0; i < header->count; i += 1) {
+            previous[i] = __atomic_load_n(&counters[i].count, __ATOMIC_RELAXED);
+        }
+
+        sleep(interval);
+
+        for (unsigned i = 0; i < header->count; i += 1) {
+            rows[i].counter = &counters[i];
+            rows[i].hits = (__atomic_load_n(&counters[i].count, __ATOMIC_RELAXED) - previous[i]) / interval;
+        }
+
+        printf("\n");
+        print_rows(rows, header->count, "HITS/S");
+        fflush(stdout);
+    }
+
+    return 0;
+}